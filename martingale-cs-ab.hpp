@@ -0,0 +1,162 @@
+#ifndef MARTINGALE_CS_AB_HPP
+#define MARTINGALE_CS_AB_HPP
+/*
+ * Early-stopping A/B comparison of two implementations' run times.
+ *
+ *   const martingale_cs::ab_result result = martingale_cs::ab_compare(
+ *       [&] { old_version(input); }, [&] { new_version(input); });
+ *   if (result.decision == martingale_cs::tester::kHigh)
+ *           ... the new version is faster ...
+ *
+ * Each round times the two callables in ABBA or BAAB order, picked by
+ * a fair coin, and turns the total times `a` and `b` into the
+ * normalized difference `(a - b) / (a + b)`, clipped to `[-clip,
+ * clip]`.  Either order cancels linear drift (e.g., from frequency
+ * scaling) within the round, but not other position effects, like a
+ * cold first call or a predictor that warms up.  The coin takes care
+ * of those: when A and B are the same, the four timings don't depend
+ * on the coin, and flipping it only flips the sign of the difference,
+ * so each round's difference has zero mean even after clipping.  The
+ * rounds feed a two-sided `martingale_cs::tester`, and the comparison
+ * stops as soon as the tester rejects that null, or after
+ * `max_rounds`.
+ *
+ * The clipping range is the main knob: the threshold scales linearly
+ * with `clip`, so a small `clip` detects small relative differences
+ * much earlier, at the cost of saturating on large ones.  Anything
+ * beyond `clip = 1` is a no-op.
+ *
+ * Timing relies on `clock_gettime(CLOCK_MONOTONIC)` by default, or on
+ * the TSC on x86-64.  When the callables are too quick for the clock,
+ * set `inner_iterations` to time several calls at once.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <time.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define MARTINGALE_CS_AB_TSC
+#endif
+
+#include "martingale-cs-tester.hpp"
+
+namespace martingale_cs {
+
+struct ab_options {
+	/* See `martingale_cs_tester_init`. */
+	uint64_t min_count = 32;
+	double log_eps = std::log(1e-3);
+	/* Normalized differences are clipped to `[-clip, clip]`. */
+	double clip = 0.5;
+	/* Gives up (undecided) after this many rounds of four calls. */
+	uint64_t max_rounds = 1000000;
+	/* Seeds the coin that picks ABBA or BAAB for each round. */
+	uint64_t seed = 0;
+	/* Number of back-to-back calls per timed sample. */
+	uint64_t inner_iterations = 1;
+	/* Read the TSC instead of `CLOCK_MONOTONIC` (x86-64 only). */
+	bool use_tsc = false;
+};
+
+struct ab_result {
+	/*
+	 * `kHigh` if A is slower than B, `kLow` if A is faster, and
+	 * `kUndecided` if we ran out of rounds.
+	 */
+	tester::decision decision;
+	uint64_t rounds;
+	/* Mean clipped normalized difference, `(a - b) / (a + b)`. */
+	double mean_difference;
+	/* Total ticks (ns or TSC cycles) for each callable. */
+	uint64_t a_ticks;
+	uint64_t b_ticks;
+};
+
+namespace detail {
+
+inline uint64_t ab_now(bool use_tsc)
+{
+#ifdef MARTINGALE_CS_AB_TSC
+	if (use_tsc) {
+		unsigned int aux;
+
+		/* rdtscp waits for earlier instructions to retire. */
+		return __rdtscp(&aux);
+	}
+#else
+	(void)use_tsc;
+#endif
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000
+	    + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+template <typename Fn>
+uint64_t ab_time(Fn &fn, uint64_t inner_iterations, bool use_tsc)
+{
+	const uint64_t begin = ab_now(use_tsc);
+
+	for (uint64_t i = 0; i < inner_iterations; ++i) {
+		fn();
+	}
+
+	return ab_now(use_tsc) - begin;
+}
+
+} // namespace detail
+
+/*
+ * Times `a()` and `b()` in randomly ordered ABBA or BAAB rounds until
+ * the tester decides which is slower, or `options.max_rounds` rounds.
+ */
+template <typename A, typename B>
+ab_result ab_compare(A a, B b, const ab_options &options = ab_options())
+{
+	const uint64_t inner = options.inner_iterations;
+	const bool use_tsc = options.use_tsc;
+	tester test(options.min_count, -options.clip, options.clip,
+	    options.log_eps);
+	std::mt19937_64 coin(options.seed);
+	ab_result ret = { tester::kUndecided, 0, 0, 0, 0 };
+
+	while (ret.rounds < options.max_rounds && !test.decided()) {
+		uint64_t a_ticks, b_ticks;
+
+		if (coin() & 1) {
+			a_ticks = detail::ab_time(a, inner, use_tsc);
+			b_ticks = detail::ab_time(b, inner, use_tsc);
+			b_ticks += detail::ab_time(b, inner, use_tsc);
+			a_ticks += detail::ab_time(a, inner, use_tsc);
+		} else {
+			b_ticks = detail::ab_time(b, inner, use_tsc);
+			a_ticks = detail::ab_time(a, inner, use_tsc);
+			a_ticks += detail::ab_time(a, inner, use_tsc);
+			b_ticks += detail::ab_time(b, inner, use_tsc);
+		}
+
+		const double total = static_cast<double>(a_ticks + b_ticks);
+		const double delta = static_cast<double>(a_ticks)
+		    - static_cast<double>(b_ticks);
+		/* The tester clips to [-clip, clip]. */
+		test.push((total > 0) ? delta / total : 0);
+		ret.a_ticks += a_ticks;
+		ret.b_ticks += b_ticks;
+		ret.rounds++;
+	}
+
+	ret.decision = test.status();
+	if (ret.rounds > 0) {
+		ret.mean_difference = test.sum() / ret.rounds;
+	}
+
+	return ret;
+}
+
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_AB_HPP */
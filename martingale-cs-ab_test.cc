@@ -0,0 +1,77 @@
+#include "martingale-cs-ab.hpp"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace {
+uint64_t Spin(uint64_t iterations)
+{
+	uint64_t x = 1;
+
+	for (uint64_t i = 0; i < iterations; ++i) {
+		x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+		asm volatile("" : "+r"(x));
+	}
+
+	return x;
+}
+
+TEST(MartingaleCsAb, DetectsSlowerSide)
+{
+	for (bool use_tsc : { false, true }) {
+		martingale_cs::ab_options options;
+		options.use_tsc = use_tsc;
+
+		// 10x more work should be obvious well before the budget.
+		const martingale_cs::ab_result slow_a
+		    = martingale_cs::ab_compare([] { Spin(20000); },
+			[] { Spin(2000); }, options);
+		EXPECT_EQ(slow_a.decision, martingale_cs::tester::kHigh);
+		EXPECT_LT(slow_a.rounds, 1000);
+		EXPECT_GT(slow_a.a_ticks, slow_a.b_ticks);
+		EXPECT_GT(slow_a.mean_difference, 0);
+
+		const martingale_cs::ab_result fast_a
+		    = martingale_cs::ab_compare([] { Spin(2000); },
+			[] { Spin(20000); }, options);
+		EXPECT_EQ(fast_a.decision, martingale_cs::tester::kLow);
+		EXPECT_LT(fast_a.rounds, 1000);
+		EXPECT_LT(fast_a.mean_difference, 0);
+	}
+}
+
+// A slow first call in each round must not make identical callables
+// look different.
+TEST(MartingaleCsAb, PositionEffect)
+{
+	martingale_cs::ab_options options;
+	uint64_t calls = 0;
+	const auto fn = [&] { Spin((calls++ % 4 == 0) ? 20000 : 2000); };
+
+	options.max_rounds = 2000;
+	const martingale_cs::ab_result result
+	    = martingale_cs::ab_compare(fn, fn, options);
+
+	EXPECT_EQ(result.decision, martingale_cs::tester::kUndecided);
+	EXPECT_EQ(result.rounds, 2000);
+	EXPECT_EQ(calls, 2000 * 4);
+}
+
+TEST(MartingaleCsAb, StopsAtBudget)
+{
+	martingale_cs::ab_options options;
+	uint64_t a_calls = 0, b_calls = 0;
+
+	// The tester can't decide before min_count rounds.
+	options.max_rounds = 10;
+	options.inner_iterations = 3;
+	const martingale_cs::ab_result result = martingale_cs::ab_compare(
+	    [&] { a_calls++; }, [&] { b_calls++; }, options);
+
+	EXPECT_EQ(result.decision, martingale_cs::tester::kUndecided);
+	EXPECT_EQ(result.rounds, 10);
+	EXPECT_EQ(a_calls, 10 * 2 * 3);
+	EXPECT_EQ(b_calls, 10 * 2 * 3);
+}
+} // namespace
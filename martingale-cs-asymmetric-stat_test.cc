@@ -1,77 +1,83 @@
 #include "martingale-cs.h"
+#include "martingale-cs-quantile.h"
+#include "martingale-cs-trial-runner.hpp"
 
-#include <algorithm>
 #include <cmath>
 #include <iostream>
-#include <limits>
 #include <random>
-#include <utility>
+#include <sstream>
 
 #include "external/csm/csm.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace {
-std::pair<double, double> EstimateQuantile(double quantile, size_t min_count,
-    double eps, std::vector<double> *observations)
-{
-	const ssize_t lower_index = std::floor(quantile * observations->size()
-	    + martingale_cs_quantile_slop_lo(
-		  quantile, observations->size(), min_count, std::log(eps)));
-	const size_t upper_index = std::ceil(quantile * observations->size()
-	    + martingale_cs_quantile_slop_hi(
-		  quantile, observations->size(), min_count, std::log(eps)));
-
-	double low_value = -std::numeric_limits<double>::max();
-	double high_value = std::numeric_limits<double>::max();
-
-	if (lower_index >= 0 && !observations->empty()) {
-		std::nth_element(observations->begin(),
-		    observations->begin() + lower_index, observations->end());
-		low_value = observations->at(lower_index);
-	}
+static const size_t kMinObservations = 32;
 
-	if (upper_index < observations->size()) {
-		std::nth_element(observations->begin(),
-		    observations->begin() + upper_index, observations->end());
-		high_value = observations->at(upper_index);
+// Trial i seeds its RNG with (kSeed, i), so the sequence of results
+// doesn't depend on the number of threads.  Change the seed to run a
+// different experiment.
+static const uint32_t kSeed = 0x5eed;
+
+// Each thread reuses one engine (and its node array) for all its
+// trials.
+struct Workspace {
+	Workspace(double quantile, double eps)
+	{
+		martingale_cs_quantile_init(
+		    &engine, quantile, kMinObservations, std::log(eps));
 	}
 
-	return std::make_pair(low_value, high_value);
-}
+	~Workspace() { martingale_cs_quantile_deinit(&engine); }
+
+	Workspace(const Workspace &) = delete;
+	Workspace &operator=(const Workspace &) = delete;
+
+	struct martingale_cs_quantile engine;
+};
 
-// Runs the quantile estimation procedure for niter iterations at
-// 1-eps confidence level.  Returns whether the actual quantile was in
-// range at all iterations.
-bool QuantileInRange(const double quantile, const double eps, size_t niter)
+// Runs the quantile estimation procedure for niter iterations with
+// `engine`, initialised for `quantile` at 1-eps confidence level.
+// Returns whether the actual quantile was in range at all iterations.
+bool QuantileInRange(const double quantile, size_t niter, size_t trial,
+    struct martingale_cs_quantile *engine)
 {
-	static const size_t kMinObservations = 32;
 	const double expected = 100 * quantile;
 
-	std::random_device dev;
-	std::mt19937 rng(dev());
+	std::seed_seq seed { kSeed, static_cast<uint32_t>(trial) };
+	std::mt19937 rng(seed);
 
 	std::uniform_real_distribution<double> dist(0, 100);
-	std::vector<double> observations;
+	bool in_range = true;
 
-	observations.reserve(niter);
+	martingale_cs_quantile_clear(engine);
 	for (size_t i = 0; i < niter; ++i) {
-		observations.push_back(dist(rng));
+		if (martingale_cs_quantile_push(engine, dist(rng)) != 0) {
+			std::cout << "allocation failure\n";
+			in_range = false;
+			break;
+		}
 
 		if (i >= kMinObservations) {
 			double lo, hi;
-			std::tie(lo, hi) = EstimateQuantile(
-			    quantile, kMinObservations, eps, &observations);
+			martingale_cs_quantile_bounds(engine, &lo, &hi);
 
 			if (expected < lo || expected > hi) {
-				std::cout << "fail after " << i + 1 << ": "
-					  << lo << " " << hi << "\n";
-				return false;
+				// One write, so lines from different threads
+				// don't interleave.
+				std::ostringstream message;
+
+				message << "trial " << trial
+					<< ": fail after " << i + 1 << ": "
+					<< lo << " " << hi << "\n";
+				std::cout << message.str();
+				in_range = false;
+				break;
 			}
 		}
 	}
 
-	return true;
+	return in_range;
 }
 
 class QuantileTest : public testing::TestWithParam<double> {
@@ -115,30 +121,38 @@ TEST_P(QuantileTest, IncludedInRange)
 		  << std::endl;
 
 	size_t successes = 0;
-	for (size_t i = 0; i < kMaxIter; ++i) {
-		if (QuantileInRange(quantile, eps, kInnerIter)) {
-			++successes;
-		}
-
-		const size_t total = i + 1;
-		if ((total % 100) == 0) {
-			std::cout << "Current: " << successes << " / "
-				  << total << " (" << 1.0 * successes / total
-				  << ")." << std::endl;
-		}
-
-		if (csm(total, 1.0 - eps, successes, std::log(1e-4),
-			nullptr)) {
-			std::cout << "Actual rate " << 1.0 * successes / total
-				  << "\n";
-			EXPECT_LE(1.0 - 1.0 * successes / total, eps)
-			    << successes << " / " << total;
-			return;
-		}
-	}
-
-	EXPECT_TRUE(false) << "Only " << successes << " successes out of "
-			   << kMaxIter << ".";
+	bool decided = false;
+	martingale_cs::run_trials(
+	    kMaxIter, [=] { return Workspace(quantile, eps); },
+	    [=](size_t trial, Workspace &workspace) {
+		    return QuantileInRange(
+			quantile, kInnerIter, trial, &workspace.engine);
+	    },
+	    [&](size_t trial, bool success) {
+		    const size_t total = trial + 1;
+
+		    successes += success ? 1 : 0;
+		    if ((total % 100) == 0) {
+			    std::cout << "Current: " << successes << " / "
+				      << total << " ("
+				      << 1.0 * successes / total << ")."
+				      << std::endl;
+		    }
+
+		    if (csm(total, 1.0 - eps, successes, std::log(1e-4),
+			    nullptr)) {
+			    std::cout << "Actual rate "
+				      << 1.0 * successes / total << "\n";
+			    EXPECT_LE(1.0 - 1.0 * successes / total, eps)
+				<< successes << " / " << total;
+			    decided = true;
+		    }
+
+		    return decided;
+	    });
+
+	EXPECT_TRUE(decided) << "Only " << successes << " successes out of "
+			     << kMaxIter << ".";
 }
 
 INSTANTIATE_TEST_SUITE_P(
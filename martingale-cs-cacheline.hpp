@@ -0,0 +1,66 @@
+#ifndef MARTINGALE_CS_CACHELINE_HPP
+#define MARTINGALE_CS_CACHELINE_HPP
+/*
+ * Cache-line-aligned heap storage.
+ *
+ * `alignas(64)` only holds for static and automatic objects until
+ * C++17: before that, `new` ignores extended alignment, and objects
+ * that should own their cache line(s) may straddle lines and share
+ * them with their neighbours.  These helpers allocate with
+ * `posix_memalign` instead, whatever the language level.
+ *
+ *   martingale_cs::line_ptr<T> p = martingale_cs::make_line_aligned<T>(
+ *       constructor arguments...);
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace martingale_cs {
+constexpr size_t kCacheLine = 64;
+
+/*
+ * Returns `size` bytes aligned to a cache line, or throws
+ * `std::bad_alloc`.  Release with `std::free`.
+ */
+inline void *allocate_lines(size_t size)
+{
+	void *ret = nullptr;
+
+	if (posix_memalign(&ret, kCacheLine, (size > 0) ? size : 1) != 0) {
+		throw std::bad_alloc();
+	}
+
+	return ret;
+}
+
+template <typename T> struct line_deleter {
+	void operator()(T *object) const
+	{
+		object->~T();
+		std::free(object);
+	}
+};
+
+template <typename T> using line_ptr = std::unique_ptr<T, line_deleter<T>>;
+
+/* Constructs a `T` in storage from `allocate_lines`. */
+template <typename T, typename... Args>
+line_ptr<T> make_line_aligned(Args &&... args)
+{
+	static_assert(alignof(T) <= kCacheLine, "Over-aligned type.");
+	void *storage = allocate_lines(sizeof(T));
+
+	try {
+		return line_ptr<T>(
+		    new (storage) T(std::forward<Args>(args)...));
+	} catch (...) {
+		std::free(storage);
+		throw;
+	}
+}
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_CACHELINE_HPP */
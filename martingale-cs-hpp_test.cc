@@ -0,0 +1,140 @@
+#include "martingale-cs.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+
+#include "gtest/gtest.h"
+
+namespace {
+namespace mcs = martingale_cs;
+
+// log(1e-3) + martingale_cs_eq: a two-sided test at eps = 1e-3.
+constexpr double kLogEps = -0x1.e6752f96f46dep+2;
+
+// Values of the C functions for kLogEps and min_count = 32, pinned
+// down at compile time; CompileTimeValuesMatch checks them at runtime.
+static_assert(mcs::threshold(31, 32, kLogEps) == HUGE_VAL, "");
+static_assert(mcs::threshold(32, 32, kLogEps) == 0x1.9e601c521965ep+4, "");
+static_assert(mcs::threshold(1000, 32, kLogEps) == 0x1.36407ed4a24dfp+7, "");
+static_assert(
+    mcs::threshold(1 << 20, 32, kLogEps) == 0x1.4dc65f2d23746p+12, "");
+static_assert(
+    mcs::threshold(1ULL << 40, 32, kLogEps) == 0x1.6064f300a2a7p+22, "");
+static_assert(
+    mcs::threshold(UINT64_MAX, 32, kLogEps) == 0x1.6c7a9991ffb9fp+34, "");
+static_assert(
+    mcs::threshold_span(1000, 32, 1, kLogEps) == 0x1.36407ed4a24ep+6, "");
+static_assert(mcs::threshold(100, 32, 0) == -HUGE_VAL, "");
+
+static_assert(mcs::detail::sqrt_up(4) == mcs::detail::next(2), "");
+static_assert(mcs::detail::sqrt_nearest(2) == 0x1.6a09e667f3bcdp+0, "");
+
+constexpr mcs::threshold_table<> kTable(32, kLogEps);
+
+static_assert(kTable(31) == HUGE_VAL, "");
+static_assert(kTable(32) >= mcs::threshold(39, 32, kLogEps), "");
+static_assert(kTable(1000) >= mcs::threshold(1000, 32, kLogEps), "");
+static_assert(kTable(UINT64_MAX) >= mcs::threshold(UINT64_MAX, 32, kLogEps),
+    "");
+static_assert(kTable.index(UINT64_MAX) + 1 == kTable.kSize, "");
+
+#if defined(__cpp_nontype_template_args)                                     \
+    && __cpp_nontype_template_args >= 201911L
+static_assert(mcs::static_threshold_table<32, kLogEps>(1000) == kTable(1000));
+#endif
+
+uint64_t Bits(double x)
+{
+	uint64_t bits;
+
+	std::memcpy(&bits, &x, sizeof(bits));
+	return bits;
+}
+
+TEST(MartingaleCsHpp, CompileTimeValuesMatch)
+{
+	EXPECT_DOUBLE_EQ(std::log(1e-3) + martingale_cs_eq, kLogEps);
+
+	for (uint64_t n : { uint64_t(31), uint64_t(32), uint64_t(1000),
+		 uint64_t(1) << 20, uint64_t(1) << 40, UINT64_MAX }) {
+		EXPECT_EQ(Bits(mcs::threshold(n, 32, kLogEps)),
+		    Bits(martingale_cs_threshold(n, 32, kLogEps)))
+		    << n;
+	}
+
+	EXPECT_EQ(Bits(mcs::threshold_span(1000, 32, 1, kLogEps)),
+	    Bits(martingale_cs_threshold_span(1000, 32, 1, kLogEps)));
+}
+
+// Evaluates the constexpr code at runtime, on many more inputs.
+TEST(MartingaleCsHpp, MatchesC)
+{
+	std::mt19937_64 rng(42);
+
+	for (size_t i = 0; i < 100000; ++i) {
+		const uint64_t n = rng() >> (rng() % 64);
+		const uint64_t min_count = rng() % 1000;
+		const double log_eps = -std::ldexp(1.0 + (rng() % 1000), -5);
+		const double span = std::ldexp(1.0 + (rng() % 100), -3);
+
+		ASSERT_EQ(Bits(mcs::threshold(n, min_count, log_eps)),
+		    Bits(martingale_cs_threshold(n, min_count, log_eps)))
+		    << n << " " << min_count << " " << log_eps;
+		ASSERT_EQ(
+		    Bits(mcs::threshold_span(n, min_count, span, log_eps)),
+		    Bits(martingale_cs_threshold_span(
+			n, min_count, span, log_eps)))
+		    << n << " " << min_count << " " << span << " " << log_eps;
+	}
+}
+
+TEST(MartingaleCsHpp, SqrtCorrectlyRounded)
+{
+	std::mt19937_64 rng(1);
+
+	for (size_t i = 0; i < 100000; ++i) {
+		const double x = std::ldexp(
+		    1.0 + std::ldexp(double(rng() >> 11), -53),
+		    int(rng() % 400) - 200);
+
+		ASSERT_EQ(
+		    Bits(mcs::detail::sqrt_nearest(x)), Bits(std::sqrt(x)))
+		    << x;
+	}
+}
+
+TEST(MartingaleCsHpp, TableConservative)
+{
+	constexpr mcs::threshold_table<3> table(100, -10, 3);
+	std::mt19937_64 rng(2);
+
+	for (size_t i = 0; i < table.kSize; ++i) {
+		const uint64_t lo = table.bucket_begin(i);
+		const uint64_t hi = table.bucket_end(i);
+
+		ASSERT_LE(lo, hi);
+		ASSERT_EQ(table.index(lo), i);
+		ASSERT_EQ(table.index(hi), i);
+		if (i + 1 < table.kSize) {
+			ASSERT_EQ(table.bucket_begin(i + 1), hi + 1);
+		}
+
+		for (uint64_t n : { lo, hi, lo + (rng() % (hi - lo + 1)) }) {
+			ASSERT_GE(table(n),
+			    martingale_cs_threshold_span(n, 100, 3, -10))
+			    << n;
+		}
+
+		if (lo >= 100) {
+			// At most ~sqrt(1 + 1/8) looser, and then a bit.
+			const double exact
+			    = martingale_cs_threshold_span(lo, 100, 3, -10);
+			ASSERT_LE(table(lo), 1.07 * exact) << lo;
+		}
+	}
+
+	EXPECT_EQ(table.bucket_end(table.kSize - 1), UINT64_MAX);
+}
+} // namespace
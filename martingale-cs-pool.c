@@ -0,0 +1,436 @@
+#include "martingale-cs-pool.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MARTINGALE_CS_X86_BATCH 1
+#include <immintrin.h>
+#else
+#define MARTINGALE_CS_X86_BATCH 0
+#endif
+
+#define TABLE_SIZE MARTINGALE_CS_INT_TABLE_SIZE
+
+static const struct martingale_cs_int_table *config_tables(
+    const struct martingale_cs_pool *pool, size_t id)
+{
+	const size_t config = (size_t)pool->min_count_index[id]
+		* pool->num_log_eps
+	    + pool->eps_index[id];
+
+	return &pool->tables[2 * config];
+}
+
+/* First `n` in bucket `i`; see `martingale_cs_int_table_init`. */
+static uint64_t bucket_begin(size_t i)
+{
+	const unsigned sub_bits = MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS;
+	unsigned shift;
+
+	if (i < ((size_t)2 << sub_bits)) {
+		return i;
+	}
+
+	shift = (unsigned)(i >> sub_bits) - 1;
+	return (uint64_t)(i - ((size_t)shift << sub_bits)) << shift;
+}
+
+/*
+ * Returns the smallest `n' > n` at which `sum + (n' - n) step` exceeds
+ * the table's bound for `n'`, or `UINT32_MAX` if there is none below
+ * that.  The bounds are constant within each bucket, so we only have
+ * to solve for the crossing in each bucket, in order.
+ */
+static uint32_t next_crossing(const struct martingale_cs_int_table *table,
+    uint64_t n, int64_t sum, int64_t step)
+{
+	if (step <= 0) {
+		return UINT32_MAX;
+	}
+
+	for (size_t i = martingale_cs_int_table_index(n + 1);
+	     i < MARTINGALE_CS_INT_TABLE_SIZE; i++) {
+		const int64_t bound = table->bound[i];
+		const uint64_t end = bucket_begin(i + 1);
+		uint64_t begin = bucket_begin(i);
+		uint64_t crossing;
+
+		begin = (begin > n) ? begin : n + 1;
+		if (begin >= UINT32_MAX) {
+			break;
+		}
+
+		if (bound == INT64_MAX) {
+			continue;
+		}
+
+		if (sum > bound) {
+			return (uint32_t)begin;
+		}
+
+		/* `(bound - sum) / step + 1` more observations. */
+		crossing = n + ((uint64_t)bound - (uint64_t)sum) / step + 1;
+		crossing = (crossing > begin) ? crossing : begin;
+		if (crossing < end) {
+			return (crossing < UINT32_MAX) ? (uint32_t)crossing
+						       : UINT32_MAX;
+		}
+	}
+
+	return UINT32_MAX;
+}
+
+/* The countdown from `n` to the earlier of two crossings. */
+static uint16_t countdown(uint64_t n, uint32_t high, uint32_t low)
+{
+	const uint64_t crossing = (high < low) ? high : low;
+	const uint64_t left = (crossing > n) ? crossing - n : 0;
+
+	return (left < MARTINGALE_CS_POOL_LEFT_MAX)
+	    ? (uint16_t)left
+	    : MARTINGALE_CS_POOL_LEFT_MAX;
+}
+
+/* The countdown for a fresh test (n = 0, sum = 0). */
+static uint16_t first_left(
+    const struct martingale_cs_int_table *tables, int64_t lo, int64_t hi)
+{
+	return countdown(0, next_crossing(&tables[0], 0, 0, hi),
+	    next_crossing(&tables[1], 0, 0, -lo));
+}
+
+static void mark_due(struct martingale_cs_pool *pool, size_t id)
+{
+	pool->due[id / 64] |= UINT64_C(1) << (id % 64);
+	pool->due_words[id / 4096] |= UINT64_C(1) << (id / 64 % 64);
+}
+
+int martingale_cs_pool_init(struct martingale_cs_pool *pool,
+    size_t num_tests, int64_t lo, int64_t hi, const uint64_t *min_counts,
+    size_t num_min_counts, const double *log_eps, size_t num_log_eps)
+{
+	/* The vector sweep loads whole blocks of 64 tests. */
+	const size_t num_words = (num_tests + 63) / 64;
+	const size_t num_summaries = (num_words + 63) / 64;
+	const size_t capacity = 64 * num_words + 64;
+	const size_t num_configs = num_min_counts * num_log_eps;
+
+	assert(num_tests <= (size_t)UINT32_MAX + 1 && "Too many tests.");
+	assert(lo >= -(INT64_C(1) << 31) && lo <= 0 && 0 <= hi
+	    && hi <= (INT64_C(1) << 31) && "Range must contain 0.");
+	assert(num_min_counts >= 1 && num_min_counts <= 256
+	    && "1 to 256 min_counts.");
+	assert(num_log_eps >= 1 && num_log_eps <= 256
+	    && "1 to 256 log_eps.");
+
+	memset(pool, 0, sizeof(*pool));
+	pool->num_tests = num_tests;
+	pool->lo = lo;
+	pool->hi = hi;
+	pool->num_min_counts = num_min_counts;
+	pool->num_log_eps = num_log_eps;
+	pool->isa = martingale_cs_batch_isa();
+	pool->n = calloc(capacity, sizeof(uint32_t));
+	pool->sum = calloc(capacity, sizeof(int64_t));
+	pool->min_count_index = calloc(capacity, sizeof(uint8_t));
+	pool->eps_index = calloc(capacity, sizeof(uint8_t));
+	pool->left = calloc(capacity, sizeof(uint16_t));
+	pool->due = calloc(num_words + 1, sizeof(uint64_t));
+	pool->due_words = calloc(num_summaries + 1, sizeof(uint64_t));
+	pool->tables
+	    = calloc(2 * num_configs, sizeof(struct martingale_cs_int_table));
+	pool->first_left = calloc(num_configs, sizeof(uint16_t));
+	if (pool->n == NULL || pool->sum == NULL
+	    || pool->min_count_index == NULL || pool->eps_index == NULL
+	    || pool->left == NULL || pool->due == NULL
+	    || pool->due_words == NULL || pool->tables == NULL
+	    || pool->first_left == NULL) {
+		martingale_cs_pool_deinit(pool);
+		return -1;
+	}
+
+	for (size_t i = 0; i < num_min_counts; i++) {
+		for (size_t j = 0; j < num_log_eps; j++) {
+			const size_t config = i * num_log_eps + j;
+			/* Two-sided. */
+			const double eps = log_eps[j] + martingale_cs_eq;
+			struct martingale_cs_config high, low;
+
+			martingale_cs_config_init_range(&high, min_counts[i],
+			    (double)lo, (double)hi, eps);
+			martingale_cs_config_init_range(&low, min_counts[i],
+			    -(double)hi, -(double)lo, eps);
+			martingale_cs_int_table_init(
+			    &pool->tables[2 * config], &high, 1);
+			martingale_cs_int_table_init(
+			    &pool->tables[2 * config + 1], &low, 1);
+			pool->first_left[config]
+			    = first_left(pool->tables + 2 * config, lo, hi);
+		}
+	}
+
+	for (size_t i = 0; i < num_tests; i++) {
+		pool->left[i] = pool->first_left[0];
+	}
+
+	return 0;
+}
+
+void martingale_cs_pool_deinit(struct martingale_cs_pool *pool)
+{
+	free(pool->n);
+	free(pool->sum);
+	free(pool->min_count_index);
+	free(pool->eps_index);
+	free(pool->left);
+	free(pool->due);
+	free(pool->due_words);
+	free(pool->tables);
+	free(pool->first_left);
+	memset(pool, 0, sizeof(*pool));
+}
+
+void martingale_cs_pool_set_config(struct martingale_cs_pool *pool,
+    uint32_t id, size_t min_count_index, size_t eps_index)
+{
+	assert(id < pool->num_tests && "Test id out of range.");
+	assert(min_count_index < pool->num_min_counts
+	    && eps_index < pool->num_log_eps && "Config out of range.");
+
+	pool->min_count_index[id] = (uint8_t)min_count_index;
+	pool->eps_index[id] = (uint8_t)eps_index;
+	if (pool->left[id] > MARTINGALE_CS_POOL_LEFT_MAX) {
+		return;
+	}
+
+	/* Fresh tests wait for their config's first check. */
+	if (pool->n[id] == 0) {
+		const size_t config
+		    = min_count_index * pool->num_log_eps + eps_index;
+
+		pool->left[id] = pool->first_left[config];
+	} else {
+		pool->left[id] = 0;
+		mark_due(pool, id);
+	}
+}
+
+void martingale_cs_pool_add(struct martingale_cs_pool *pool,
+    const uint32_t *ids, const int64_t *values, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		martingale_cs_pool_push(pool, ids[i], values[i]);
+	}
+}
+
+/* Sets the countdown to the next check for undecided test `id`. */
+static void schedule(struct martingale_cs_pool *pool, size_t id)
+{
+	const struct martingale_cs_int_table *tables
+	    = config_tables(pool, id);
+	const uint64_t n = pool->n[id];
+	const int64_t sum = pool->sum[id];
+	const uint32_t high = next_crossing(&tables[0], n, sum, pool->hi);
+	const uint32_t low = next_crossing(&tables[1], n, -sum, -pool->lo);
+
+	pool->left[id] = countdown(n, high, low);
+}
+
+/* Returns 1 if test `id` just decided. */
+static size_t check_one(struct martingale_cs_pool *pool, size_t id)
+{
+	const struct martingale_cs_int_table *tables
+	    = config_tables(pool, id);
+	const uint64_t n = pool->n[id];
+	const int64_t sum = pool->sum[id];
+
+	if (pool->left[id] > MARTINGALE_CS_POOL_LEFT_MAX) {
+		return 0;
+	}
+
+	if (martingale_cs_int_table_exceeds(&tables[0], sum, n)) {
+		pool->left[id] = MARTINGALE_CS_POOL_LEFT_HIGH;
+		return 1;
+	}
+
+	if (martingale_cs_int_table_exceeds(&tables[1], -sum, n)) {
+		pool->left[id] = MARTINGALE_CS_POOL_LEFT_LOW;
+		return 1;
+	}
+
+	schedule(pool, id);
+	return 0;
+}
+
+/*
+ * Clears and returns the next non-zero `due` word after `*cursor`, and
+ * its index in `*index`, or returns 0 once there are none left.
+ * `*words` holds the unvisited bits of the current summary word.
+ */
+static uint64_t next_due_word(struct martingale_cs_pool *pool,
+    size_t *cursor, uint64_t *words, size_t *index)
+{
+	const size_t num_summaries = (pool->num_tests + 4095) / 4096;
+	uint64_t due = 0;
+
+	while (due == 0) {
+		while (*words == 0) {
+			if (*cursor >= num_summaries) {
+				return 0;
+			}
+
+			*words = pool->due_words[*cursor];
+			pool->due_words[(*cursor)++] = 0;
+		}
+
+		*index = 64 * (*cursor - 1)
+		    + (size_t)__builtin_ctzll(*words);
+		*words &= *words - 1;
+		due = pool->due[*index];
+		pool->due[*index] = 0;
+	}
+
+	return due;
+}
+
+static size_t sweep_scalar(struct martingale_cs_pool *pool)
+{
+	size_t cursor = 0, i = 0;
+	uint64_t words = 0, due;
+	size_t ret = 0;
+
+	while ((due = next_due_word(pool, &cursor, &words, &i)) != 0) {
+		for (size_t bit = 0; due != 0; bit++, due >>= 1) {
+			if (due & 1) {
+				ret += check_one(pool, 64 * i + bit);
+			}
+		}
+	}
+
+	return ret;
+}
+
+#if MARTINGALE_CS_X86_BATCH
+#define AVX512_TARGET __attribute__((target("avx512f,avx512dq")))
+
+/*
+ * Checks the tests in `[begin, begin + 8)` whose bit is set in
+ * `mask`, and returns the mask of tests that just decided.
+ * `martingale_cs_int_table_index` finds the bucket with a `clz`; here,
+ * `n < 2^32` converts exactly to double, and the exponent field is
+ * `63 - clz(n)`.
+ */
+AVX512_TARGET static __mmask8 check_eight(
+    struct martingale_cs_pool *pool, size_t begin, __mmask8 mask)
+{
+	const unsigned sub_bits = MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS;
+	const long long *bounds = (const long long *)pool->tables[0].bound;
+	const __m256i n32
+	    = _mm256_loadu_si256((const __m256i *)(pool->n + begin));
+	const __m512i n = _mm512_cvtepu32_epi64(n32);
+	const __m512i exponent = _mm512_sub_epi64(
+	    _mm512_srli_epi64(
+		_mm512_castpd_si512(_mm512_cvtepu32_pd(n32)), 52),
+	    _mm512_set1_epi64(1023 + sub_bits));
+	/* n < 2^(sub_bits + 1) is its own bucket. */
+	const __m512i shift
+	    = _mm512_max_epi64(exponent, _mm512_setzero_si512());
+	const __m512i bucket = _mm512_add_epi64(
+	    _mm512_slli_epi64(shift, sub_bits), _mm512_srlv_epi64(n, shift));
+	const __m128i *min_counts
+	    = (const __m128i *)(pool->min_count_index + begin);
+	const __m128i *epss = (const __m128i *)(pool->eps_index + begin);
+	const __m512i min_count_index
+	    = _mm512_cvtepu8_epi64(_mm_loadl_epi64(min_counts));
+	const __m512i eps_index = _mm512_cvtepu8_epi64(_mm_loadl_epi64(epss));
+	const __m512i config = _mm512_add_epi64(
+	    _mm512_mullo_epi64(min_count_index,
+		_mm512_set1_epi64((long long)pool->num_log_eps)),
+	    eps_index);
+	const __m512i high_index = _mm512_add_epi64(
+	    _mm512_mullo_epi64(config, _mm512_set1_epi64(2 * TABLE_SIZE)),
+	    bucket);
+	const __m512i low_index = _mm512_add_epi64(
+	    high_index, _mm512_set1_epi64(TABLE_SIZE));
+	const __m512i left = _mm512_cvtepu16_epi64(
+	    _mm_loadu_si128((const __m128i *)(pool->left + begin)));
+	const __mmask8 active = _mm512_mask_cmple_epu64_mask(
+	    mask, left, _mm512_set1_epi64(MARTINGALE_CS_POOL_LEFT_MAX));
+	const __m512i sum = _mm512_loadu_si512(pool->sum + begin);
+	const __m512i high_bound = _mm512_mask_i64gather_epi64(
+	    _mm512_setzero_si512(), active, high_index, bounds, 8);
+	const __m512i low_bound = _mm512_mask_i64gather_epi64(
+	    _mm512_setzero_si512(), active, low_index, bounds, 8);
+	const __mmask8 high
+	    = _mm512_mask_cmpgt_epi64_mask(active, sum, high_bound);
+	const __mmask8 low = _mm512_mask_cmpgt_epi64_mask(active & ~high,
+	    _mm512_sub_epi64(_mm512_setzero_si512(), sum), low_bound);
+	__m512i decided;
+
+	if ((high | low) == 0) {
+		return 0;
+	}
+
+	decided = _mm512_mask_mov_epi64(
+	    _mm512_set1_epi64(MARTINGALE_CS_POOL_LEFT_LOW), high,
+	    _mm512_set1_epi64(MARTINGALE_CS_POOL_LEFT_HIGH));
+	_mm512_mask_cvtepi64_storeu_epi16(pool->left + begin, high | low,
+	    decided);
+	return high | low;
+}
+
+AVX512_TARGET static size_t sweep_avx512(struct martingale_cs_pool *pool)
+{
+	size_t cursor = 0, i = 0;
+	uint64_t words = 0, due;
+	size_t ret = 0;
+
+	while ((due = next_due_word(pool, &cursor, &words, &i)) != 0) {
+		for (size_t j = 0; j < 64; j += 8) {
+			const __mmask8 mask = (__mmask8)(due >> j);
+			__mmask8 decided;
+			unsigned rest;
+
+			if (mask == 0) {
+				continue;
+			}
+
+			decided = check_eight(pool, 64 * i + j, mask);
+			ret += (size_t)__builtin_popcount(decided);
+			rest = mask & ~decided;
+			for (size_t k = 0; rest != 0; k++, rest >>= 1) {
+				const size_t id = 64 * i + j + k;
+
+				if ((rest & 1)
+				    && pool->left[id]
+					<= MARTINGALE_CS_POOL_LEFT_MAX) {
+					schedule(pool, id);
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+#endif /* MARTINGALE_CS_X86_BATCH */
+
+size_t martingale_cs_pool_sweep_isa(struct martingale_cs_pool *pool, int isa)
+{
+	const int best = martingale_cs_batch_isa();
+
+	isa = (isa > best) ? best : isa;
+#if MARTINGALE_CS_X86_BATCH
+	if (isa == MARTINGALE_CS_ISA_AVX512) {
+		return sweep_avx512(pool);
+	}
+#endif
+
+	return sweep_scalar(pool);
+}
+
+size_t martingale_cs_pool_sweep(struct martingale_cs_pool *pool)
+{
+	return martingale_cs_pool_sweep_isa(pool, pool->isa);
+}
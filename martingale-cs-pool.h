@@ -0,0 +1,182 @@
+#ifndef MARTINGALE_CS_POOL_H
+#define MARTINGALE_CS_POOL_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "martingale-cs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pool of many (millions of) small two-sided sequential tests, e.g.,
+ * one per (experiment, metric, segment), stored as a struct of arrays.
+ *
+ * Observations are integers in `[lo, hi]`, shared by every test in
+ * the pool: pick a fixed-point unit such that the observations are
+ * integers (e.g., microseconds), and the sums are exact.  Each test
+ * takes 16 bytes and a bit: a 32-bit count, a 64-bit sum, the indices
+ * of its `min_count` and `log_eps` in the pool's lists, a 16-bit word
+ * that holds either the status of a decided test or the countdown to
+ * an undecided test's next check, and a due bit (plus a bit per 64
+ * tests to summarise the due bits).
+ *
+ * The thresholds come from `martingale_cs_int_table`s shared by all
+ * the tests with the same (`min_count`, `log_eps`) pair, so the
+ * footprint of the thresholds only depends on the number of configs
+ * (4 KB each).  The table bounds are conservative, but up to ~12%
+ * looser than `martingale_cs_config_threshold`.
+ *
+ * Like `martingale_cs_tester`, each test finds the earliest n at
+ * which its sum could exceed a bound, given that each observation
+ * moves the sum by at most `hi` (or `-lo` downward); with bounds that
+ * are constant over each bucket of n, that's exact integer
+ * arithmetic.  The test counts down the observations until then,
+ * saturated at 16 bits: a test whose crossing is further away is
+ * simply rechecked (and rescheduled) after `2^16 - 3` observations.
+ *
+ * `martingale_cs_pool_add` scatter-adds batches of observations keyed
+ * by test id, and only marks a test due once its countdown reaches 0.
+ * `martingale_cs_pool_sweep` finds the due tests through the summary
+ * bits, and checks them eight at a time with AVX-512 gathers when
+ * available: a sweep costs one word read per 4096 tests, plus work
+ * proportional to the number of words with due tests, not to the
+ * number of tests that changed.
+ *
+ * Checking periodically rather than after each observation only
+ * delays decisions: the confidence sequence bounds every n at once.
+ * Each test's decision is wrong with probability at most
+ * `exp(log_eps)`, and sticks once made.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_pool {
+	size_t num_tests;
+	uint32_t *n;
+	int64_t *sum;
+	uint8_t *min_count_index;
+	uint8_t *eps_index;
+	/*
+	 * Undecided tests count down to their next check, and are due
+	 * at 0; decided tests hold `MARTINGALE_CS_POOL_LEFT_{HIGH,LOW}`.
+	 */
+	uint16_t *left;
+	/* Bit `i % 64` of `due[i / 64]` is set for due tests. */
+	uint64_t *due;
+	/* Bit `w % 64` of `due_words[w / 64]` is set if `due[w] != 0`. */
+	uint64_t *due_words;
+	int64_t lo;
+	int64_t hi;
+	size_t num_min_counts;
+	size_t num_log_eps;
+	/*
+	 * Two tables per config, for `sum` and `-sum`: config
+	 * `min_count_index * num_log_eps + eps_index` owns `tables[2
+	 * config]` and `tables[2 config + 1]`.
+	 */
+	struct martingale_cs_int_table *tables;
+	/* The countdown for a fresh test, for each config. */
+	uint16_t *first_left;
+	/* `martingale_cs_batch_isa()` at init. */
+	int isa;
+};
+
+/* Same values as `MARTINGALE_CS_TESTER_*`. */
+#define MARTINGALE_CS_POOL_UNDECIDED 0
+#define MARTINGALE_CS_POOL_HIGH 1
+#define MARTINGALE_CS_POOL_LOW -1
+
+/* Private: `left` values past the longest countdown. */
+#define MARTINGALE_CS_POOL_LEFT_MAX 0xfffd
+#define MARTINGALE_CS_POOL_LEFT_HIGH 0xfffe
+#define MARTINGALE_CS_POOL_LEFT_LOW 0xffff
+
+/*
+ * Initialises `pool` for `num_tests` tests of observations in `[lo,
+ * hi]` (`-2^31 <= lo <= 0 <= hi <= 2^31`).  Each test uses one of
+ * the `num_min_counts` values in `min_counts` and one of the
+ * `num_log_eps` values in `log_eps` (at most 256 of each), initially
+ * the first of each.  Returns 0 on success, and -1 if memory
+ * allocation failed.
+ */
+int martingale_cs_pool_init(struct martingale_cs_pool *pool,
+    size_t num_tests, int64_t lo, int64_t hi, const uint64_t *min_counts,
+    size_t num_min_counts, const double *log_eps, size_t num_log_eps);
+
+void martingale_cs_pool_deinit(struct martingale_cs_pool *pool);
+
+/*
+ * Sets the config of test `id` to `min_counts[min_count_index]` and
+ * `log_eps[eps_index]`.  Call before adding observations to the test.
+ */
+void martingale_cs_pool_set_config(struct martingale_cs_pool *pool,
+    uint32_t id, size_t min_count_index, size_t eps_index);
+
+/*
+ * Adds `value` (clipped to `[lo, hi]`) to test `id`.  Each test
+ * takes at most `UINT32_MAX` observations.
+ */
+static inline void martingale_cs_pool_push(
+    struct martingale_cs_pool *pool, uint32_t id, int64_t value)
+{
+	uint16_t left;
+
+	assert(id < pool->num_tests && "Test id out of range.");
+	assert(pool->n[id] < UINT32_MAX && "Observation count overflow.");
+
+	left = pool->left[id];
+	value = (value < pool->lo) ? pool->lo : value;
+	value = (value > pool->hi) ? pool->hi : value;
+	pool->sum[id] += value;
+	pool->n[id]++;
+	/* Decided tests never become due again. */
+	if (left > 1 && left <= MARTINGALE_CS_POOL_LEFT_MAX) {
+		pool->left[id] = left - 1;
+	} else if (left <= 1) {
+		pool->left[id] = 0;
+		pool->due[id / 64] |= UINT64_C(1) << (id % 64);
+		pool->due_words[id / 4096] |= UINT64_C(1) << (id / 64 % 64);
+	}
+}
+
+/* Adds `values[i]` to test `ids[i]`, for `i < count`. */
+void martingale_cs_pool_add(struct martingale_cs_pool *pool,
+    const uint32_t *ids, const int64_t *values, size_t count);
+
+/*
+ * Checks every due test against its thresholds, schedules the next
+ * check for the undecided ones, and clears the due bits.  Returns the
+ * number of tests that decided during this sweep.
+ */
+size_t martingale_cs_pool_sweep(struct martingale_cs_pool *pool);
+
+/*
+ * Same, with a specific `MARTINGALE_CS_ISA_*` kernel, or the widest
+ * supported one if the CPU doesn't support `isa`.
+ */
+size_t martingale_cs_pool_sweep_isa(struct martingale_cs_pool *pool, int isa);
+
+/*
+ * Returns `MARTINGALE_CS_POOL_UNDECIDED`, or the direction in which
+ * test `id` rejected the null hypothesis, as of the last sweep.
+ */
+static inline int martingale_cs_pool_status(
+    const struct martingale_cs_pool *pool, uint32_t id)
+{
+	switch (pool->left[id]) {
+	case MARTINGALE_CS_POOL_LEFT_HIGH:
+		return MARTINGALE_CS_POOL_HIGH;
+	case MARTINGALE_CS_POOL_LEFT_LOW:
+		return MARTINGALE_CS_POOL_LOW;
+	default:
+		return MARTINGALE_CS_POOL_UNDECIDED;
+	}
+}
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* !MARTINGALE_CS_POOL_H */
@@ -0,0 +1,223 @@
+#include "martingale-cs-pool.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+const uint64_t kMinCounts[] = { 32, 100, 1000 };
+const double kLogEps[] = { -3, -5, std::log(1e-6) };
+
+// Sweeping only due tests, with either kernel, must match checking
+// every test against its own tables after each batch.
+TEST(MartingaleCsPool, SweepMatchesNaive)
+{
+	const size_t kTests = 1000;
+	std::mt19937_64 rng(1);
+	struct martingale_cs_pool scalar, avx512;
+	std::vector<struct martingale_cs_int_table> high(9), low(9);
+	std::vector<size_t> config(kTests);
+	std::vector<double> p_hi(kTests);
+	std::vector<uint64_t> n(kTests, 0);
+	std::vector<int64_t> sum(kTests, 0);
+	std::vector<int> expected(kTests, MARTINGALE_CS_POOL_UNDECIDED);
+	size_t decided = 0;
+
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t j = 0; j < 3; ++j) {
+			const double eps = kLogEps[j] + martingale_cs_eq;
+			struct martingale_cs_config c;
+
+			martingale_cs_config_init_range(
+			    &c, kMinCounts[i], -2, 3, eps);
+			martingale_cs_int_table_init(&high[3 * i + j], &c, 1);
+			martingale_cs_config_init_range(
+			    &c, kMinCounts[i], -3, 2, eps);
+			martingale_cs_int_table_init(&low[3 * i + j], &c, 1);
+		}
+	}
+
+	ASSERT_EQ(martingale_cs_pool_init(&scalar, kTests, -2, 3, kMinCounts,
+		      3, kLogEps, 3),
+	    0);
+	ASSERT_EQ(martingale_cs_pool_init(&avx512, kTests, -2, 3, kMinCounts,
+		      3, kLogEps, 3),
+	    0);
+	for (size_t i = 0; i < kTests; ++i) {
+		config[i] = rng() % 9;
+		// Mean of 0 for p_hi = 0.4, plus some drift either way.
+		p_hi[i] = 0.4 + ((rng() % 21) - 10.0) / 100.0;
+		martingale_cs_pool_set_config(
+		    &scalar, i, config[i] / 3, config[i] % 3);
+		martingale_cs_pool_set_config(
+		    &avx512, i, config[i] / 3, config[i] % 3);
+	}
+
+	for (size_t iter = 0; iter < 200; ++iter) {
+		std::vector<uint32_t> ids;
+		std::vector<int64_t> values;
+
+		// Only some of the tests get data in each batch.
+		for (size_t j = 0; j < 5000; ++j) {
+			const uint32_t id = rng() % (kTests / 2 + iter * 2);
+
+			if (id >= kTests) {
+				continue;
+			}
+
+			std::bernoulli_distribution coin(p_hi[id]);
+			const int64_t hi = 3 + rng() % 2;
+
+			ids.push_back(id);
+			// Values outside [-2, 3] are clipped.
+			values.push_back(coin(rng) ? hi : -2);
+			n[id]++;
+		}
+
+		martingale_cs_pool_add(
+		    &scalar, ids.data(), values.data(), ids.size());
+		martingale_cs_pool_add(
+		    &avx512, ids.data(), values.data(), ids.size());
+		for (size_t j = 0; j < ids.size(); ++j) {
+			sum[ids[j]] += (values[j] > 3) ? 3 : values[j];
+		}
+
+		size_t newly = 0;
+		for (size_t i = 0; i < kTests; ++i) {
+			if (expected[i] != MARTINGALE_CS_POOL_UNDECIDED) {
+				continue;
+			}
+
+			if (martingale_cs_int_table_exceeds(
+				&high[config[i]], sum[i], n[i])) {
+				expected[i] = MARTINGALE_CS_POOL_HIGH;
+				++newly;
+			} else if (martingale_cs_int_table_exceeds(
+				       &low[config[i]], -sum[i], n[i])) {
+				expected[i] = MARTINGALE_CS_POOL_LOW;
+				++newly;
+			}
+		}
+
+		ASSERT_EQ(martingale_cs_pool_sweep_isa(
+			      &scalar, MARTINGALE_CS_ISA_SCALAR),
+		    newly);
+		ASSERT_EQ(martingale_cs_pool_sweep_isa(
+			      &avx512, MARTINGALE_CS_ISA_AVX512),
+		    newly);
+		for (size_t i = 0; i < kTests; ++i) {
+			ASSERT_EQ(martingale_cs_pool_status(&scalar, i),
+			    expected[i])
+			    << iter << " " << i;
+			ASSERT_EQ(martingale_cs_pool_status(&avx512, i),
+			    expected[i])
+			    << iter << " " << i;
+		}
+
+		decided += newly;
+	}
+
+	// Make sure the test exercises decisions in both directions.
+	EXPECT_GT(decided, 100);
+	martingale_cs_pool_deinit(&scalar);
+	martingale_cs_pool_deinit(&avx512);
+}
+
+// A test with a sum near 0 is only due again once it could cross.
+TEST(MartingaleCsPool, SkipsTestsThatCannotCross)
+{
+	struct martingale_cs_pool pool;
+	size_t checks = 0;
+
+	ASSERT_EQ(martingale_cs_pool_init(
+		      &pool, 1, -1, 1, kMinCounts, 1, kLogEps, 1),
+	    0);
+	for (size_t i = 0; i < 100000; ++i) {
+		martingale_cs_pool_push(&pool, 0, (i % 2) ? 1 : -1);
+		checks += pool.due[0] != 0;
+		martingale_cs_pool_sweep(&pool);
+	}
+
+	EXPECT_EQ(martingale_cs_pool_status(&pool, 0),
+	    MARTINGALE_CS_POOL_UNDECIDED);
+	// The threshold grows like sqrt(n log log n), so the gaps
+	// between checks grow too.
+	EXPECT_LT(checks, 2000);
+	EXPECT_GT(pool.left[0], 100);
+	martingale_cs_pool_deinit(&pool);
+}
+
+// Sweeps find due words through the summary bits, and never look at
+// the other words.
+TEST(MartingaleCsPool, SweepSkipsIdleWords)
+{
+	const size_t kTests = 100000;
+	const size_t kWords = (kTests + 63) / 64;
+	struct martingale_cs_pool pool;
+
+	ASSERT_EQ(martingale_cs_pool_init(
+		      &pool, kTests, -1, 1, kMinCounts, 1, kLogEps, 1),
+	    0);
+	for (int isa : { MARTINGALE_CS_ISA_SCALAR, MARTINGALE_CS_ISA_AVX512 }) {
+		// No test can cross before min_count observations.
+		martingale_cs_pool_push(&pool, 12345, 1);
+		EXPECT_EQ(pool.due[12345 / 64], 0);
+		EXPECT_EQ(martingale_cs_pool_sweep_isa(&pool, isa), 0);
+
+		// Garbage in words the summary doesn't flag stays put.
+		for (size_t i = 0; i < kWords; ++i) {
+			pool.due[i] = ~UINT64_C(0);
+		}
+
+		EXPECT_EQ(martingale_cs_pool_sweep_isa(&pool, isa), 0);
+		for (size_t i = 0; i < kWords; ++i) {
+			ASSERT_EQ(pool.due[i], ~UINT64_C(0)) << i;
+			pool.due[i] = 0;
+		}
+	}
+
+	// Due tests flag their word in the summary.
+	martingale_cs_pool_push(&pool, 70000, 1);
+	martingale_cs_pool_set_config(&pool, 70000, 0, 0);
+	EXPECT_EQ(pool.due[70000 / 64], UINT64_C(1) << (70000 % 64));
+	EXPECT_EQ(pool.due_words[70000 / 4096],
+	    UINT64_C(1) << (70000 / 64 % 64));
+	EXPECT_EQ(martingale_cs_pool_sweep(&pool), 0);
+	EXPECT_EQ(pool.due[70000 / 64], 0);
+	EXPECT_EQ(pool.due_words[70000 / 4096], 0);
+	martingale_cs_pool_deinit(&pool);
+}
+
+TEST(MartingaleCsPool, Decides)
+{
+	struct martingale_cs_pool pool;
+	std::mt19937_64 rng(2);
+	std::bernoulli_distribution coin(0.5);
+
+	ASSERT_EQ(martingale_cs_pool_init(
+		      &pool, 3, -1, 1, kMinCounts, 1, kLogEps, 1),
+	    0);
+	for (size_t i = 0; i < 100000; ++i) {
+		const bool flip = coin(rng);
+
+		martingale_cs_pool_push(&pool, 0, flip ? 1 : -1);
+		martingale_cs_pool_push(&pool, 1, (i % 3) ? 1 : -1);
+		martingale_cs_pool_push(&pool, 2, (i % 3) ? -1 : 1);
+		if (i % 1000 == 0) {
+			martingale_cs_pool_sweep(&pool);
+		}
+	}
+
+	martingale_cs_pool_sweep(&pool);
+	EXPECT_EQ(martingale_cs_pool_status(&pool, 0),
+	    MARTINGALE_CS_POOL_UNDECIDED);
+	EXPECT_EQ(martingale_cs_pool_status(&pool, 1),
+	    MARTINGALE_CS_POOL_HIGH);
+	EXPECT_EQ(martingale_cs_pool_status(&pool, 2),
+	    MARTINGALE_CS_POOL_LOW);
+	martingale_cs_pool_deinit(&pool);
+}
+} // namespace
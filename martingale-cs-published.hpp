@@ -0,0 +1,167 @@
+#ifndef MARTINGALE_CS_PUBLISHED_HPP
+#define MARTINGALE_CS_PUBLISHED_HPP
+/*
+ * Testers whose state other threads can read without blocking the
+ * writer, e.g., for a monitoring thread that watches thousands of
+ * tests.
+ *
+ *   // Writer (one thread per tester):
+ *   martingale_cs::published_tester test(32, -1, 1, log_eps);
+ *   test.push(x);
+ *
+ *   // Any other thread:
+ *   const martingale_cs::published_tester::snapshot s = test.read();
+ *
+ * Each push updates a private `martingale_cs_tester` and publishes
+ * (n, sum, decision, decided-at-n) through a `seqlock`, so readers
+ * always see the state after some push, and never make the writer
+ * wait.  Each tester sits on its own cache line(s), so arrays of
+ * testers written by different threads don't share lines either.
+ * Static and automatic testers always get that alignment, but `new`
+ * only honours it since C++17; before that, allocate testers with
+ * `make_line_aligned`:
+ *
+ *   martingale_cs::line_ptr<martingale_cs::published_tester> test
+ *       = martingale_cs::make_line_aligned<
+ *           martingale_cs::published_tester>(32, -1, 1, log_eps);
+ *
+ * `snapshot_scanner` reads many testers that share their parameters,
+ * and computes the thresholds at every snapshot's n with one call to
+ * `martingale_cs_config_threshold_batch` (AVX2 or AVX-512 when
+ * available).
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "martingale-cs-cacheline.hpp"
+#include "martingale-cs-seqlock.hpp"
+#include "martingale-cs-tester.hpp"
+
+namespace martingale_cs {
+class alignas(kCacheLine) published_tester {
+    public:
+	struct snapshot {
+		uint64_t n;
+		/* Sum of the (clipped) observations. */
+		double sum;
+		tester::decision decision;
+		/* The `n` at which the tester decided, or 0. */
+		uint64_t decided_at;
+	};
+
+	/* See `martingale_cs_tester_init`. */
+	published_tester(uint64_t min_count, double lo, double hi,
+	    double log_eps, bool two_sided = true)
+	{
+		martingale_cs_tester_init(
+		    &tester_, min_count, lo, hi, log_eps, two_sided ? 1 : 0);
+	}
+
+	published_tester(const published_tester &) = delete;
+	published_tester &operator=(const published_tester &) = delete;
+
+	/* Only one thread may push at once. */
+	tester::decision push(double x)
+	{
+		martingale_cs_tester_push(&tester_, x);
+		return publish();
+	}
+
+	tester::decision push_many(const double *xs, size_t count)
+	{
+		martingale_cs_tester_push_many(&tester_, xs, count);
+		return publish();
+	}
+
+	/* The state after some push; safe from any thread. */
+	snapshot read() const { return published_.load(); }
+
+    private:
+	friend class snapshot_scanner;
+
+	tester::decision publish()
+	{
+		const auto status = static_cast<tester::decision>(
+		    martingale_cs_tester_status(&tester_));
+
+		if (status != tester::kUndecided && decided_at_ == 0) {
+			decided_at_ = tester_.n;
+		}
+
+		published_.store(
+		    { tester_.n, tester_.sum, status, decided_at_ });
+		return status;
+	}
+
+	/* Only the writer touches `tester_` (except the configs). */
+	struct martingale_cs_tester tester_;
+	uint64_t decided_at_ = 0;
+	seqlock<snapshot> published_;
+};
+
+class snapshot_scanner {
+    public:
+	struct result {
+		published_tester::snapshot snapshot;
+		/*
+		 * The thresholds at `snapshot.n` for `sum` and `-sum`
+		 * (`HUGE_VAL` for `-sum` in one-sided tests).
+		 */
+		double high;
+		double low;
+	};
+
+	/*
+	 * Reads `testers[i]` into `out[i]`, for `i < count`.  The testers
+	 * must have been constructed with the same parameters.
+	 *
+	 * Each snapshot is consistent, but the snapshots are not taken
+	 * at the same instant.
+	 */
+	void scan(const published_tester *const *testers, size_t count,
+	    result *out)
+	{
+		if (count == 0) {
+			return;
+		}
+
+		const auto &first = testers[0]->tester_;
+
+		n_.resize(count);
+		thresholds_.resize(count);
+		for (size_t i = 0; i < count; ++i) {
+			out[i].snapshot = testers[i]->read();
+			n_[i] = out[i].snapshot.n;
+		}
+
+		martingale_cs_config_threshold_batch(
+		    &first.high, n_.data(), thresholds_.data(), count);
+		for (size_t i = 0; i < count; ++i) {
+			out[i].high = thresholds_[i];
+			out[i].low = HUGE_VAL;
+		}
+
+		if (!first.two_sided) {
+			return;
+		}
+
+		/* Symmetric ranges have the same threshold on both sides. */
+		if (first.lo != -first.hi) {
+			martingale_cs_config_threshold_batch(&first.low,
+			    n_.data(), thresholds_.data(), count);
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			out[i].low = thresholds_[i];
+		}
+	}
+
+    private:
+	std::vector<uint64_t> n_;
+	std::vector<double> thresholds_;
+};
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_PUBLISHED_HPP */
@@ -0,0 +1,116 @@
+#include "martingale-cs-published.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+TEST(MartingaleCsPublished, MatchesTester)
+{
+	std::mt19937_64 rng(1);
+	std::bernoulli_distribution coin(0.55);
+	martingale_cs::published_tester published(32, -1, 1, -5);
+	martingale_cs::tester expected(32, -1, 1, -5);
+	uint64_t decided_at = 0;
+
+	for (size_t i = 0; i < 20000; ++i) {
+		const double x = coin(rng) ? 1 : -1;
+		const auto status = expected.push(x);
+
+		if (status != martingale_cs::tester::kUndecided
+		    && decided_at == 0) {
+			decided_at = i + 1;
+		}
+
+		ASSERT_EQ(published.push(x), status);
+
+		const auto snapshot = published.read();
+		ASSERT_EQ(snapshot.n, expected.count());
+		ASSERT_EQ(snapshot.sum, expected.sum());
+		ASSERT_EQ(snapshot.decision, status);
+		ASSERT_EQ(snapshot.decided_at, decided_at);
+	}
+
+	EXPECT_NE(decided_at, 0);
+}
+
+// Readers never see a torn (n, sum) pair.
+TEST(MartingaleCsPublished, ConsistentSnapshots)
+{
+	const uint64_t kCount = 1000000;
+	martingale_cs::published_tester test(32, -1, 1, -5);
+	std::atomic<bool> done(false);
+	std::thread writer([&] {
+		for (uint64_t i = 0; i < kCount; ++i) {
+			// The sum is 1 for odd n, 0 for even n.
+			test.push((i % 2) ? -1 : 1);
+		}
+
+		done = true;
+	});
+
+	while (!done) {
+		const auto snapshot = test.read();
+		const bool decided
+		    = snapshot.decision != martingale_cs::tester::kUndecided;
+
+		ASSERT_EQ(snapshot.sum, snapshot.n % 2) << snapshot.n;
+		ASSERT_EQ(decided, snapshot.decided_at != 0);
+		ASSERT_LE(snapshot.decided_at, snapshot.n);
+	}
+
+	writer.join();
+	EXPECT_EQ(test.read().n, kCount);
+}
+
+TEST(MartingaleCsPublished, ScannerThresholds)
+{
+	std::mt19937_64 rng(2);
+	std::vector<martingale_cs::line_ptr<martingale_cs::published_tester>>
+	    owned;
+	std::vector<const martingale_cs::published_tester *> testers;
+	struct martingale_cs_config high, low;
+	martingale_cs::snapshot_scanner scanner;
+
+	martingale_cs_config_init_range(
+	    &high, 32, -1, 3, -5 + martingale_cs_eq);
+	martingale_cs_config_init_range(
+	    &low, 32, -3, 1, -5 + martingale_cs_eq);
+	for (size_t i = 0; i < 1000; ++i) {
+		owned.push_back(martingale_cs::make_line_aligned<
+		    martingale_cs::published_tester>(32, -1, 3, -5));
+		ASSERT_EQ(reinterpret_cast<uintptr_t>(owned.back().get())
+			% martingale_cs::kCacheLine,
+		    0);
+		for (size_t j = rng() % 5000; j > 0; --j) {
+			owned.back()->push((rng() % 4 == 0) ? 3 : -1);
+		}
+
+		testers.push_back(owned.back().get());
+	}
+
+	std::vector<martingale_cs::snapshot_scanner::result> results(
+	    testers.size());
+	scanner.scan(testers.data(), testers.size(), results.data());
+	for (size_t i = 0; i < testers.size(); ++i) {
+		const auto &result = results[i];
+		const uint64_t n = result.snapshot.n;
+		const double expected_high
+		    = martingale_cs_config_threshold(&high, n);
+		const double expected_low
+		    = martingale_cs_config_threshold(&low, n);
+
+		EXPECT_EQ(n, testers[i]->read().n);
+		// The batch kernels are conservative, within a few ULPs.
+		EXPECT_GE(result.high, expected_high) << n;
+		EXPECT_LE(result.high, expected_high * (1 + 1e-12)) << n;
+		EXPECT_GE(result.low, expected_low) << n;
+		EXPECT_LE(result.low, expected_low * (1 + 1e-12)) << n;
+	}
+}
+} // namespace
@@ -0,0 +1,545 @@
+#include "martingale-cs-quantile.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+struct martingale_cs_quantile_node {
+	double value;
+	size_t left;
+	size_t right;
+	/* Number of nodes in the subtree rooted here. */
+	size_t size;
+};
+
+/*
+ * Treap priorities: a hash of the node's index, so we don't have to
+ * store them.  Any decent mixing function gives O(log n) expected
+ * depth; this is the splitmix64 finaliser.
+ */
+static uint64_t priority(size_t index)
+{
+	uint64_t x = (uint64_t)index + 0x9E3779B97F4A7C15ULL;
+
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static void update_size(struct martingale_cs_quantile_node *nodes, size_t i)
+{
+	nodes[i].size = 1 + nodes[nodes[i].left].size
+	    + nodes[nodes[i].right].size;
+}
+
+/* Inserts node `node` in the subtree at `root`; returns the new root. */
+static size_t insert(
+    struct martingale_cs_quantile_node *nodes, size_t root, size_t node)
+{
+	size_t child;
+
+	if (root == 0) {
+		return node;
+	}
+
+	/* Equal values go right, so insertion order breaks ties. */
+	if (nodes[node].value < nodes[root].value) {
+		child = insert(nodes, nodes[root].left, node);
+		nodes[root].left = child;
+		if (priority(child) > priority(root)) {
+			/* Rotate right. */
+			nodes[root].left = nodes[child].right;
+			nodes[child].right = root;
+			update_size(nodes, root);
+			update_size(nodes, child);
+			return child;
+		}
+	} else {
+		child = insert(nodes, nodes[root].right, node);
+		nodes[root].right = child;
+		if (priority(child) > priority(root)) {
+			/* Rotate left. */
+			nodes[root].right = nodes[child].left;
+			nodes[child].left = root;
+			update_size(nodes, root);
+			update_size(nodes, child);
+			return child;
+		}
+	}
+
+	nodes[root].size++;
+	return root;
+}
+
+void martingale_cs_quantile_init(struct martingale_cs_quantile *engine,
+    double quantile, uint64_t min_count, double log_eps)
+{
+	martingale_cs_quantile_config_init(
+	    &engine->config, min_count, log_eps, 1, 0);
+	martingale_cs_quantile_scale_init(&engine->scale, quantile);
+	engine->nodes = NULL;
+	engine->root = 0;
+	engine->count = 0;
+	engine->capacity = 0;
+}
+
+void martingale_cs_quantile_deinit(struct martingale_cs_quantile *engine)
+{
+	free(engine->nodes);
+	engine->nodes = NULL;
+	engine->root = 0;
+	engine->count = 0;
+	engine->capacity = 0;
+}
+
+void martingale_cs_quantile_clear(struct martingale_cs_quantile *engine)
+{
+	/* The sentinel at index 0 never changes. */
+	engine->root = 0;
+	engine->count = 0;
+}
+
+int martingale_cs_quantile_push(
+    struct martingale_cs_quantile *engine, double x)
+{
+	assert(!isnan(x) && "NaN observations have no rank.");
+
+	/* One more node, plus the sentinel at index 0. */
+	if (engine->count + 1 >= engine->capacity) {
+		const size_t capacity
+		    = (engine->capacity < 16) ? 16 : 2 * engine->capacity;
+		struct martingale_cs_quantile_node *nodes;
+
+		if (capacity > SIZE_MAX / sizeof(*nodes)) {
+			return -1;
+		}
+
+		nodes = realloc(engine->nodes, capacity * sizeof(*nodes));
+		if (nodes == NULL) {
+			return -1;
+		}
+
+		if (engine->nodes == NULL) {
+			nodes[0] = (struct martingale_cs_quantile_node) {
+				.value = 0, .left = 0, .right = 0, .size = 0
+			};
+		}
+
+		engine->nodes = nodes;
+		engine->capacity = capacity;
+	}
+
+	const size_t node = ++engine->count;
+	engine->nodes[node] = (struct martingale_cs_quantile_node) {
+		.value = x, .left = 0, .right = 0, .size = 1
+	};
+	engine->root = insert(engine->nodes, engine->root, node);
+	return 0;
+}
+
+static double select_rank(
+    const struct martingale_cs_quantile *engine, size_t rank)
+{
+	const struct martingale_cs_quantile_node *nodes = engine->nodes;
+	size_t i = engine->root;
+
+	assert(rank < engine->count && "Rank out of bounds.");
+	for (;;) {
+		const size_t left_size = nodes[nodes[i].left].size;
+
+		if (rank < left_size) {
+			i = nodes[i].left;
+		} else if (rank == left_size) {
+			return nodes[i].value;
+		} else {
+			rank -= left_size + 1;
+			i = nodes[i].right;
+		}
+	}
+}
+
+double martingale_cs_quantile_select(
+    const struct martingale_cs_quantile *engine, size_t rank)
+{
+	return select_rank(engine, rank);
+}
+
+/*
+ * Computes the ranks (maybe out of bounds) of the confidence
+ * interval's ends after `n` observations.
+ */
+static void interval_ranks(const struct martingale_cs_config *config,
+    const struct martingale_cs_quantile_scale *scale, uint64_t n,
+    double *lower_rank, double *upper_rank)
+{
+	double slop_lo, slop_hi;
+
+	martingale_cs_quantile_intervals(
+	    config, scale, 1, n, &slop_lo, &slop_hi);
+
+	const double center = scale->quantile * n;
+	*lower_rank = floor(center + slop_lo);
+	*upper_rank = ceil(center + slop_hi);
+}
+
+void martingale_cs_quantile_bounds(
+    const struct martingale_cs_quantile *engine, double *lo, double *hi)
+{
+	const size_t n = engine->count;
+	double lower_rank, upper_rank;
+
+	interval_ranks(
+	    &engine->config, &engine->scale, n, &lower_rank, &upper_rank);
+
+	*lo = -HUGE_VAL;
+	*hi = HUGE_VAL;
+	if (lower_rank >= 0 && lower_rank < n) {
+		*lo = select_rank(engine, (size_t)lower_rank);
+	}
+
+	if (upper_rank >= 0 && upper_rank < n) {
+		*hi = select_rank(engine, (size_t)upper_rank);
+	}
+}
+
+int martingale_cs_quantile_hist_init(
+    struct martingale_cs_quantile_hist *engine, double quantile,
+    uint64_t min_count, double log_eps, int64_t min_value,
+    int64_t max_value)
+{
+	assert(min_value <= max_value && "Empty range.");
+
+	martingale_cs_quantile_config_init(
+	    &engine->config, min_count, log_eps, 1, 0);
+	martingale_cs_quantile_scale_init(&engine->scale, quantile);
+	engine->min_value = min_value;
+	engine->max_value = max_value;
+	engine->bins = NULL;
+	engine->num_bins = 0;
+	engine->count = 0;
+
+	/* Plus the underflow and overflow bins. */
+	const uint64_t range = (uint64_t)max_value - (uint64_t)min_value;
+	if (range >= SIZE_MAX / sizeof(uint64_t) - 3) {
+		return -1;
+	}
+
+	engine->num_bins = (size_t)range + 3;
+	engine->dense
+	    = engine->num_bins <= MARTINGALE_CS_QUANTILE_HIST_DENSE_LIMIT + 2;
+	/* The Fenwick tree is 1-indexed. */
+	engine->bins = calloc(engine->num_bins + 1, sizeof(uint64_t));
+	return (engine->bins == NULL) ? -1 : 0;
+}
+
+void martingale_cs_quantile_hist_deinit(
+    struct martingale_cs_quantile_hist *engine)
+{
+	free(engine->bins);
+	engine->bins = NULL;
+	engine->num_bins = 0;
+	engine->count = 0;
+}
+
+static size_t hist_bin(
+    const struct martingale_cs_quantile_hist *engine, int64_t x)
+{
+	if (x < engine->min_value) {
+		return 0;
+	}
+
+	if (x > engine->max_value) {
+		return engine->num_bins - 1;
+	}
+
+	return 1 + (size_t)((uint64_t)x - (uint64_t)engine->min_value);
+}
+
+void martingale_cs_quantile_hist_push_n(
+    struct martingale_cs_quantile_hist *engine, int64_t x, uint64_t count)
+{
+	const size_t bin = hist_bin(engine, x);
+
+	engine->count += count;
+	if (engine->dense) {
+		engine->bins[bin] += count;
+		return;
+	}
+
+	for (size_t i = bin + 1; i <= engine->num_bins; i += i & -i) {
+		engine->bins[i] += count;
+	}
+}
+
+void martingale_cs_quantile_hist_push(
+    struct martingale_cs_quantile_hist *engine, int64_t x)
+{
+	martingale_cs_quantile_hist_push_n(engine, x, 1);
+}
+
+/* Returns the bin of the `rank`th smallest observation (0-indexed). */
+static size_t hist_select(
+    const struct martingale_cs_quantile_hist *engine, uint64_t rank)
+{
+	const uint64_t *bins = engine->bins;
+
+	assert(rank < engine->count && "Rank out of bounds.");
+	if (engine->dense) {
+		size_t bin = 0;
+
+		while (rank >= bins[bin]) {
+			rank -= bins[bin++];
+		}
+
+		return bin;
+	}
+
+	/*
+	 * Find the largest prefix of the Fenwick tree with total count
+	 * <= rank, one bit at a time: the next bin is the one we want.
+	 */
+	size_t step = 1;
+	size_t pos = 0;
+
+	while (step <= engine->num_bins / 2) {
+		step *= 2;
+	}
+
+	for (; step > 0; step /= 2) {
+		const size_t next = pos + step;
+
+		if (next <= engine->num_bins && bins[next] <= rank) {
+			pos = next;
+			rank -= bins[pos];
+		}
+	}
+
+	/* `pos` is 1-indexed, and one before the bin. */
+	return pos;
+}
+
+/*
+ * Conversions that round in a known direction, for bucket edges
+ * beyond 2^53.
+ */
+static double u64_to_double_down(uint64_t x)
+{
+	const double ret = (double)x;
+
+	if (ret >= 0x1p64 || (uint64_t)ret > x) {
+		return nextafter(ret, 0);
+	}
+
+	return ret;
+}
+
+static double u64_to_double_up(uint64_t x)
+{
+	const double ret = (double)x;
+
+	if (ret < 0x1p64 && (uint64_t)ret < x) {
+		return nextafter(ret, HUGE_VAL);
+	}
+
+	return ret;
+}
+
+static double i64_to_double_down(int64_t x)
+{
+	if (x >= 0) {
+		return u64_to_double_down((uint64_t)x);
+	}
+
+	return -u64_to_double_up(-(uint64_t)x);
+}
+
+static double i64_to_double_up(int64_t x)
+{
+	if (x >= 0) {
+		return u64_to_double_up((uint64_t)x);
+	}
+
+	return -u64_to_double_down(-(uint64_t)x);
+}
+
+void martingale_cs_quantile_hist_bounds(
+    const struct martingale_cs_quantile_hist *engine, double *lo,
+    double *hi)
+{
+	const uint64_t n = engine->count;
+	const size_t overflow = engine->num_bins - 1;
+	double lower_rank, upper_rank;
+
+	interval_ranks(
+	    &engine->config, &engine->scale, n, &lower_rank, &upper_rank);
+
+	*lo = -HUGE_VAL;
+	*hi = HUGE_VAL;
+	if (lower_rank >= 0 && lower_rank < n) {
+		const size_t bin = hist_select(engine, (uint64_t)lower_rank);
+
+		/*
+		 * Overflows are at least max_value + 1, which is 2^63
+		 * (and doesn't fit in an int64_t) for INT64_MAX.
+		 */
+		if (bin == overflow && engine->max_value == INT64_MAX) {
+			*lo = 0x1p63;
+		} else if (bin > 0) {
+			*lo = i64_to_double_down(
+			    engine->min_value + (int64_t)(bin - 1));
+		}
+	}
+
+	if (upper_rank >= 0 && upper_rank < n) {
+		const size_t bin = hist_select(engine, (uint64_t)upper_rank);
+
+		/*
+		 * Underflows are at most min_value - 1, which rounds up
+		 * to -2^63 for INT64_MIN.
+		 */
+		if (bin == 0 && engine->min_value == INT64_MIN) {
+			*hi = -0x1p63;
+		} else if (bin == 0) {
+			*hi = i64_to_double_up(engine->min_value - 1);
+		} else if (bin < overflow) {
+			*hi = i64_to_double_up(
+			    engine->min_value + (int64_t)(bin - 1));
+		}
+	}
+}
+
+int martingale_cs_quantile_hdr_init(
+    struct martingale_cs_quantile_hdr *hdr, unsigned sub_bucket_bits)
+{
+	assert(sub_bucket_bits < 16 && "Too many buckets per power of 2.");
+
+	/*
+	 * The largest index is `((63 - bits) << bits) + 2^(bits + 1) -
+	 * 1`, for UINT64_MAX.
+	 */
+	hdr->num_buckets = (size_t)(65 - sub_bucket_bits) << sub_bucket_bits;
+	hdr->sub_bucket_bits = sub_bucket_bits;
+	hdr->count = 0;
+	hdr->counts = calloc(hdr->num_buckets, sizeof(uint64_t));
+	return (hdr->counts == NULL) ? -1 : 0;
+}
+
+void martingale_cs_quantile_hdr_deinit(
+    struct martingale_cs_quantile_hdr *hdr)
+{
+	free(hdr->counts);
+	hdr->counts = NULL;
+	hdr->num_buckets = 0;
+	hdr->count = 0;
+}
+
+void martingale_cs_quantile_hdr_push_many(
+    struct martingale_cs_quantile_hdr *hdr, const uint64_t *values,
+    size_t count)
+{
+	/*
+	 * Compute indices for a block of values in a separate loop,
+	 * which the compiler can vectorise, then scatter the
+	 * increments.
+	 */
+	enum { block = 64 };
+	const unsigned bits = hdr->sub_bucket_bits;
+	uint64_t *counts = hdr->counts;
+	size_t indices[block];
+
+	hdr->count += count;
+	while (count > 0) {
+		const size_t n = (count < block) ? count : block;
+
+		for (size_t i = 0; i < n; i++) {
+			indices[i] = martingale_cs_quantile_hdr_index(
+			    bits, values[i]);
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			counts[indices[i]]++;
+		}
+
+		values += n;
+		count -= n;
+	}
+}
+
+int martingale_cs_quantile_hdr_merge(struct martingale_cs_quantile_hdr *dst,
+    const struct martingale_cs_quantile_hdr *src)
+{
+	if (dst->sub_bucket_bits != src->sub_bucket_bits) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < dst->num_buckets; i++) {
+		dst->counts[i] += src->counts[i];
+	}
+
+	dst->count += src->count;
+	return 0;
+}
+
+uint64_t martingale_cs_quantile_hdr_bucket_begin(
+    const struct martingale_cs_quantile_hdr *hdr, size_t index)
+{
+	const unsigned bits = hdr->sub_bucket_bits;
+
+	if (index < ((size_t)2 << bits)) {
+		return index;
+	}
+
+	/* Invert `martingale_cs_quantile_hdr_index`. */
+	const unsigned shift = (unsigned)(index >> bits) - 1;
+	return (uint64_t)(index - ((size_t)shift << bits)) << shift;
+}
+
+uint64_t martingale_cs_quantile_hdr_bucket_end(
+    const struct martingale_cs_quantile_hdr *hdr, size_t index)
+{
+	const unsigned bits = hdr->sub_bucket_bits;
+
+	if (index < ((size_t)2 << bits)) {
+		return index;
+	}
+
+	const unsigned shift = (unsigned)(index >> bits) - 1;
+	return martingale_cs_quantile_hdr_bucket_begin(hdr, index)
+	    + ((UINT64_C(1) << shift) - 1);
+}
+
+void martingale_cs_quantile_hdr_bounds(
+    const struct martingale_cs_quantile_hdr *hdr,
+    const struct martingale_cs_config *config,
+    const struct martingale_cs_quantile_scale *scale, double *lo,
+    double *hi)
+{
+	const uint64_t n = hdr->count;
+	double lower_rank, upper_rank;
+	uint64_t seen = 0;
+	int want_lo, want_hi;
+
+	interval_ranks(config, scale, n, &lower_rank, &upper_rank);
+
+	*lo = -HUGE_VAL;
+	*hi = HUGE_VAL;
+	want_lo = lower_rank >= 0 && lower_rank < n;
+	want_hi = upper_rank >= 0 && upper_rank < n;
+
+	/* One pass for both ranks: lower_rank <= upper_rank. */
+	for (size_t i = 0; i < hdr->num_buckets && (want_lo || want_hi);
+	     i++) {
+		seen += hdr->counts[i];
+		if (want_lo && lower_rank < seen) {
+			*lo = u64_to_double_down(
+			    martingale_cs_quantile_hdr_bucket_begin(hdr, i));
+			want_lo = 0;
+		}
+
+		if (want_hi && upper_rank < seen) {
+			*hi = u64_to_double_up(
+			    martingale_cs_quantile_hdr_bucket_end(hdr, i));
+			want_hi = 0;
+		}
+	}
+}
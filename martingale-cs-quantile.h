@@ -0,0 +1,251 @@
+#ifndef MARTINGALE_CS_QUANTILE_H
+#define MARTINGALE_CS_QUANTILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "martingale-cs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Streaming confidence intervals on a quantile's value.
+ *
+ * `martingale_cs_quantile_slop_lo` and `_hi` bound the rank of the
+ * quantile among the observations; the engine keeps the observations
+ * in an order-statistic tree (a treap with subtree sizes), so that
+ * each push is an O(log n) insertion, and turning the ranks into
+ * values takes two O(log n) selections, instead of sorting or
+ * partitioning all the observations every time.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_quantile_node;
+
+struct martingale_cs_quantile {
+	struct martingale_cs_config config;
+	struct martingale_cs_quantile_scale scale;
+	/* nodes[0] is a sentinel with size 0. */
+	struct martingale_cs_quantile_node *nodes;
+	size_t root;
+	size_t count;
+	size_t capacity;
+};
+
+/*
+ * Initialises `engine` for confidence intervals on `quantile`, with
+ * `min_count` and `log_eps` as for `martingale_cs_quantile_slop_lo`.
+ * The engine is empty and doesn't allocate until the first push.
+ */
+void martingale_cs_quantile_init(struct martingale_cs_quantile *engine,
+    double quantile, uint64_t min_count, double log_eps);
+
+/* Releases the engine's memory. */
+void martingale_cs_quantile_deinit(struct martingale_cs_quantile *engine);
+
+/*
+ * Removes all the observations, but keeps the memory for the next
+ * pushes, e.g., to reuse one engine across independent trials.
+ */
+void martingale_cs_quantile_clear(struct martingale_cs_quantile *engine);
+
+/*
+ * Adds an observation in O(log n) expected time.  Returns 0 on
+ * success, and -1 if memory allocation failed (the engine is
+ * unchanged).  `x` must not be NaN.
+ */
+int martingale_cs_quantile_push(
+    struct martingale_cs_quantile *engine, double x);
+
+/* Returns the number of observations so far. */
+static inline size_t martingale_cs_quantile_count(
+    const struct martingale_cs_quantile *engine)
+{
+	return engine->count;
+}
+
+/*
+ * Returns the `rank`th smallest observation (0-indexed), for `rank <
+ * count`.
+ */
+double martingale_cs_quantile_select(
+    const struct martingale_cs_quantile *engine, size_t rank);
+
+/*
+ * Stores a `1 - exp(log_eps)` confidence interval on the quantile's
+ * value in `lo` and `hi`: the observations at ranks `floor(quantile
+ * n + slop_lo)` and `ceil(quantile n + slop_hi)`.  When a rank is out
+ * of bounds, we don't have enough observations for that side, and
+ * the bound is infinite.
+ */
+void martingale_cs_quantile_bounds(
+    const struct martingale_cs_quantile *engine, double *lo, double *hi);
+
+/*
+ * Bounded-memory variant for integer observations (e.g., cycle
+ * counts) in a known range `[min_value, max_value]`.
+ *
+ * The engine only keeps a count per value, so its memory depends on
+ * the range, not on the number of observations.  Small ranges (at
+ * most `MARTINGALE_CS_QUANTILE_HIST_DENSE_LIMIT` values) use plain
+ * counts and linear scans; larger ones, a Fenwick tree with O(log
+ * range) pushes and rank lookups.
+ *
+ * Values outside the range are counted in underflow and overflow
+ * bins.  When a bound falls in one of them, the engine returns the
+ * closest value it can prove: `min_value - 1` or `max_value + 1` for
+ * the inner side, and an infinity for the outer side.
+ *
+ * The fields are private.
+ */
+#define MARTINGALE_CS_QUANTILE_HIST_DENSE_LIMIT 256
+
+struct martingale_cs_quantile_hist {
+	struct martingale_cs_config config;
+	struct martingale_cs_quantile_scale scale;
+	int64_t min_value;
+	int64_t max_value;
+	/*
+	 * Bin 0 counts underflows, bin i in [1, num_bins - 2] the
+	 * value `min_value + i - 1`, and bin `num_bins - 1` overflows.
+	 * Plain counts when dense, a (1-indexed) Fenwick tree
+	 * otherwise.
+	 */
+	uint64_t *bins;
+	size_t num_bins;
+	int dense;
+	uint64_t count;
+};
+
+/*
+ * Initialises `engine` for `quantile` over integers in `[min_value,
+ * max_value]`; see `martingale_cs_quantile_init`.  Returns 0 on
+ * success, and -1 if the range is too large to allocate.
+ */
+int martingale_cs_quantile_hist_init(
+    struct martingale_cs_quantile_hist *engine, double quantile,
+    uint64_t min_count, double log_eps, int64_t min_value,
+    int64_t max_value);
+
+void martingale_cs_quantile_hist_deinit(
+    struct martingale_cs_quantile_hist *engine);
+
+/* Adds an observation. */
+void martingale_cs_quantile_hist_push(
+    struct martingale_cs_quantile_hist *engine, int64_t x);
+
+/* Adds `count` copies of the same observation. */
+void martingale_cs_quantile_hist_push_n(
+    struct martingale_cs_quantile_hist *engine, int64_t x, uint64_t count);
+
+/*
+ * Stores a confidence interval on the quantile's value in `lo` and
+ * `hi`, like `martingale_cs_quantile_bounds`.
+ */
+void martingale_cs_quantile_hist_bounds(
+    const struct martingale_cs_quantile_hist *engine, double *lo,
+    double *hi);
+
+/*
+ * Log-linear (HDR-style) histogram of unsigned values, e.g.,
+ * latencies in nanoseconds, with fixed memory.
+ *
+ * Values less than `2^(sub_bucket_bits + 1)` each get their own
+ * bucket; above that, each power of two `[2^k, 2^(k+1))` is split in
+ * `2^sub_bucket_bits` equal buckets, so that bucket widths are at most
+ * `2^-sub_bucket_bits` of the values they contain.  The default of 5
+ * sub-bucket bits needs 1920 buckets (15 KB), for a resolution of
+ * ~3%.
+ *
+ * The histogram doesn't depend on the quantile: `_bounds` takes the
+ * config and scale for any quantile (see
+ * `martingale_cs_quantile_intervals`), and widens the interval to
+ * bucket edges, so the result still contains the true quantile with
+ * probability `1 - exp(log_eps)`.
+ *
+ * The fields are private.
+ */
+#define MARTINGALE_CS_QUANTILE_HDR_DEFAULT_BITS 5
+
+struct martingale_cs_quantile_hdr {
+	uint64_t *counts;
+	size_t num_buckets;
+	unsigned sub_bucket_bits;
+	uint64_t count;
+};
+
+/*
+ * Initialises an empty histogram with `2^sub_bucket_bits` buckets per
+ * power of two, `sub_bucket_bits < 16`.  Returns 0 on success, -1 on
+ * allocation failure.
+ */
+int martingale_cs_quantile_hdr_init(
+    struct martingale_cs_quantile_hdr *hdr, unsigned sub_bucket_bits);
+
+void martingale_cs_quantile_hdr_deinit(
+    struct martingale_cs_quantile_hdr *hdr);
+
+/*
+ * Returns the bucket for `value`.  Branch-free, so loops over values
+ * vectorise.
+ */
+static inline size_t martingale_cs_quantile_hdr_index(
+    unsigned sub_bucket_bits, uint64_t value)
+{
+	/* floor(log2(value)), with 0 in the first bucket anyway. */
+	const int log2 = 63 - __builtin_clzll(value | 1);
+	const int excess = log2 - (int)sub_bucket_bits;
+	/* max(excess, 0) */
+	const unsigned shift = (unsigned)(excess & ~(excess >> 31));
+
+	return ((size_t)shift << sub_bucket_bits) + (size_t)(value >> shift);
+}
+
+static inline void martingale_cs_quantile_hdr_push(
+    struct martingale_cs_quantile_hdr *hdr, uint64_t value)
+{
+	hdr->counts[martingale_cs_quantile_hdr_index(
+	    hdr->sub_bucket_bits, value)]++;
+	hdr->count++;
+}
+
+/* Adds `count` values. */
+void martingale_cs_quantile_hdr_push_many(
+    struct martingale_cs_quantile_hdr *hdr, const uint64_t *values,
+    size_t count);
+
+/*
+ * Adds the counts in `src` to `dst`, e.g., to combine per-thread
+ * histograms.  Returns 0 on success, and -1 (without modifying `dst`)
+ * if the histograms have different `sub_bucket_bits`.
+ */
+int martingale_cs_quantile_hdr_merge(struct martingale_cs_quantile_hdr *dst,
+    const struct martingale_cs_quantile_hdr *src);
+
+/* Returns the smallest and largest values in bucket `index`. */
+uint64_t martingale_cs_quantile_hdr_bucket_begin(
+    const struct martingale_cs_quantile_hdr *hdr, size_t index);
+
+uint64_t martingale_cs_quantile_hdr_bucket_end(
+    const struct martingale_cs_quantile_hdr *hdr, size_t index);
+
+/*
+ * Stores a confidence interval for the quantile described by
+ * `config` and `scale` (see `martingale_cs_quantile_config_init` and
+ * `martingale_cs_quantile_scale_init`) in `lo` and `hi`: the start of
+ * the bucket for the lower rank, and the end of the bucket for the
+ * upper rank.  Bounds are infinite when we don't have enough
+ * observations.
+ */
+void martingale_cs_quantile_hdr_bounds(
+    const struct martingale_cs_quantile_hdr *hdr,
+    const struct martingale_cs_config *config,
+    const struct martingale_cs_quantile_scale *scale, double *lo,
+    double *hi);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* !MARTINGALE_CS_QUANTILE_H */
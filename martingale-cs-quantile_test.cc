@@ -0,0 +1,356 @@
+#include "martingale-cs-quantile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+TEST(MartingaleCsQuantile, SelectMatchesSort)
+{
+	const auto select = martingale_cs_quantile_select;
+	std::mt19937_64 rng(1);
+
+	for (size_t iter = 0; iter < 20; ++iter) {
+		struct martingale_cs_quantile engine;
+		std::vector<double> values;
+		// Small ranges have many duplicates.
+		const uint64_t range = (iter % 2 == 0) ? 10 : UINT64_MAX;
+
+		martingale_cs_quantile_init(&engine, 0.5, 32, -5);
+		for (size_t i = 0; i < 2000; ++i) {
+			const double x = static_cast<double>(rng() % range);
+
+			values.push_back(x);
+			ASSERT_EQ(martingale_cs_quantile_push(&engine, x), 0);
+			ASSERT_EQ(martingale_cs_quantile_count(&engine),
+			    values.size());
+
+			if (i % 97 != 0) {
+				continue;
+			}
+
+			std::vector<double> sorted = values;
+			std::sort(sorted.begin(), sorted.end());
+			for (size_t j = 0; j < sorted.size(); ++j) {
+				ASSERT_EQ(select(&engine, j), sorted[j]);
+			}
+		}
+
+		martingale_cs_quantile_deinit(&engine);
+	}
+}
+
+// Sorted input is the worst case for an unbalanced tree.
+TEST(MartingaleCsQuantile, SortedInput)
+{
+	struct martingale_cs_quantile engine;
+
+	martingale_cs_quantile_init(&engine, 0.9, 32, -5);
+	for (size_t i = 0; i < 1000000; ++i) {
+		ASSERT_EQ(martingale_cs_quantile_push(&engine, i), 0);
+	}
+
+	for (size_t rank : { 0, 1, 500000, 999999 }) {
+		EXPECT_EQ(martingale_cs_quantile_select(&engine, rank), rank);
+	}
+
+	martingale_cs_quantile_deinit(&engine);
+}
+
+// Same intervals as partitioning all observations on every push.
+TEST(MartingaleCsQuantile, BoundsMatchNthElement)
+{
+	std::mt19937_64 rng(2);
+	std::uniform_real_distribution<double> dist(0, 100);
+
+	for (double quantile : { 0.0, 0.05, 0.5, 0.99, 1.0 }) {
+		struct martingale_cs_quantile engine;
+		std::vector<double> values;
+
+		martingale_cs_quantile_init(&engine, quantile, 32, -5);
+		for (size_t i = 0; i < 3000; ++i) {
+			values.push_back(dist(rng));
+			ASSERT_EQ(martingale_cs_quantile_push(
+				      &engine, values.back()),
+			    0);
+
+			const size_t n = values.size();
+			double lo, hi;
+			double expected_lo = -HUGE_VAL;
+			double expected_hi = HUGE_VAL;
+			const double lower = std::floor(quantile * n
+			    + martingale_cs_quantile_slop_lo(
+				quantile, n, 32, -5));
+			const double upper = std::ceil(quantile * n
+			    + martingale_cs_quantile_slop_hi(
+				quantile, n, 32, -5));
+
+			if (lower >= 0 && lower < n) {
+				std::nth_element(values.begin(),
+				    values.begin() + lower, values.end());
+				expected_lo = values[lower];
+			}
+
+			if (upper >= 0 && upper < n) {
+				std::nth_element(values.begin(),
+				    values.begin() + upper, values.end());
+				expected_hi = values[upper];
+			}
+
+			martingale_cs_quantile_bounds(&engine, &lo, &hi);
+			ASSERT_EQ(lo, expected_lo) << quantile << " " << n;
+			ASSERT_EQ(hi, expected_hi) << quantile << " " << n;
+		}
+
+		martingale_cs_quantile_deinit(&engine);
+	}
+}
+
+// The histogram must match the exact engine, up to clamping values
+// outside the histogram's range.
+void CheckHistMatches(double quantile, int64_t min_value, int64_t max_value,
+    int64_t lo_gen, int64_t hi_gen, size_t count)
+{
+	struct martingale_cs_quantile exact;
+	struct martingale_cs_quantile_hist hist;
+	std::mt19937_64 rng(min_value ^ max_value);
+	std::uniform_int_distribution<int64_t> dist(lo_gen, hi_gen);
+
+	martingale_cs_quantile_init(&exact, quantile, 32, -5);
+	ASSERT_EQ(martingale_cs_quantile_hist_init(
+		      &hist, quantile, 32, -5, min_value, max_value),
+	    0);
+	for (size_t i = 0; i < count; ++i) {
+		const int64_t x = dist(rng);
+		// What the histogram can prove about x.
+		const int64_t clamped = std::min(
+		    std::max(x, min_value - 1), max_value + 1);
+		double lo, hi, hist_lo, hist_hi;
+
+		ASSERT_EQ(martingale_cs_quantile_push(&exact, clamped), 0);
+		martingale_cs_quantile_hist_push(&hist, x);
+
+		martingale_cs_quantile_bounds(&exact, &lo, &hi);
+		martingale_cs_quantile_hist_bounds(&hist, &hist_lo, &hist_hi);
+		if (lo < min_value) {
+			lo = -HUGE_VAL;
+		}
+
+		if (hi > max_value) {
+			hi = HUGE_VAL;
+		}
+
+		ASSERT_EQ(hist_lo, lo) << quantile << " " << i;
+		ASSERT_EQ(hist_hi, hi) << quantile << " " << i;
+	}
+
+	martingale_cs_quantile_deinit(&exact);
+	martingale_cs_quantile_hist_deinit(&hist);
+}
+
+TEST(MartingaleCsQuantile, DenseHistMatches)
+{
+	for (double quantile : { 0.0, 0.1, 0.5, 0.99 }) {
+		CheckHistMatches(quantile, 0, 99, 0, 99, 3000);
+		CheckHistMatches(quantile, -10, 10, -20, 15, 3000);
+	}
+}
+
+TEST(MartingaleCsQuantile, FenwickHistMatches)
+{
+	for (double quantile : { 0.0, 0.1, 0.5, 0.99, 1.0 }) {
+		CheckHistMatches(quantile, 1000, 100000, 1000, 100000, 3000);
+		CheckHistMatches(quantile, 1000, 5000, 0, 6000, 3000);
+	}
+}
+
+TEST(MartingaleCsQuantile, HistPushN)
+{
+	struct martingale_cs_quantile_hist hist;
+	double lo, hi;
+
+	ASSERT_EQ(
+	    martingale_cs_quantile_hist_init(&hist, 0.5, 32, -5, 0, 999), 0);
+	martingale_cs_quantile_hist_push_n(&hist, 100, 1000000);
+	martingale_cs_quantile_hist_push_n(&hist, 900, 1000000);
+	martingale_cs_quantile_hist_push_n(&hist, 500, 1);
+	martingale_cs_quantile_hist_bounds(&hist, &lo, &hi);
+	EXPECT_EQ(lo, 100);
+	EXPECT_EQ(hi, 900);
+	martingale_cs_quantile_hist_deinit(&hist);
+
+	EXPECT_EQ(martingale_cs_quantile_hist_init(
+		      &hist, 0.5, 32, -5, INT64_MIN, INT64_MAX),
+	    -1);
+	martingale_cs_quantile_hist_deinit(&hist);
+}
+
+// Doubles near 2^60 are 256 apart: the bounds must round outward.
+TEST(MartingaleCsQuantile, HistBoundsRoundOutward)
+{
+	const int64_t kMin = (INT64_C(1) << 60) + 200;
+
+	for (int64_t value : { kMin + 50, kMin + 100 }) {
+		struct martingale_cs_quantile_hist hist;
+		double lo, hi;
+
+		ASSERT_EQ(martingale_cs_quantile_hist_init(
+			      &hist, 0.5, 32, -5, kMin, kMin + 200),
+		    0);
+		martingale_cs_quantile_hist_push_n(&hist, value, 1000);
+		martingale_cs_quantile_hist_bounds(&hist, &lo, &hi);
+		// Both bounds are integers below 2^63.
+		EXPECT_LE(static_cast<int64_t>(lo), value);
+		EXPECT_GT(static_cast<int64_t>(lo), value - 256);
+		EXPECT_GE(static_cast<int64_t>(hi), value);
+		EXPECT_LT(static_cast<int64_t>(hi), value + 256);
+		martingale_cs_quantile_hist_deinit(&hist);
+	}
+}
+
+// Ranges that end at INT64_MIN or INT64_MAX: the bins past the range
+// have no int64_t value.
+TEST(MartingaleCsQuantile, HistBoundsAtInt64Limits)
+{
+	for (double quantile : { 0.0, 0.5, 1.0 }) {
+		struct martingale_cs_quantile_hist hist;
+		double lo, hi;
+
+		ASSERT_EQ(martingale_cs_quantile_hist_init(&hist, quantile,
+			      32, -5, INT64_MAX - 100, INT64_MAX),
+		    0);
+		martingale_cs_quantile_hist_push_n(&hist, INT64_MAX, 1000);
+		martingale_cs_quantile_hist_bounds(&hist, &lo, &hi);
+		EXPECT_LE(lo, 0x1p63);
+		EXPECT_GE(hi, 0x1p63);
+		martingale_cs_quantile_hist_deinit(&hist);
+
+		ASSERT_EQ(martingale_cs_quantile_hist_init(&hist, quantile,
+			      32, -5, INT64_MIN, INT64_MIN + 100),
+		    0);
+		martingale_cs_quantile_hist_push_n(&hist, INT64_MIN, 1000);
+		martingale_cs_quantile_hist_bounds(&hist, &lo, &hi);
+		EXPECT_LE(lo, -0x1p63);
+		EXPECT_GE(hi, -0x1p63);
+		martingale_cs_quantile_hist_deinit(&hist);
+	}
+}
+
+TEST(MartingaleCsQuantile, HdrBuckets)
+{
+	for (unsigned bits : { 0, 2, 5 }) {
+		struct martingale_cs_quantile_hdr hdr;
+		uint64_t expected_begin = 0;
+		const auto index = martingale_cs_quantile_hdr_index;
+
+		ASSERT_EQ(martingale_cs_quantile_hdr_init(&hdr, bits), 0);
+		for (size_t i = 0; i < hdr.num_buckets; ++i) {
+			const uint64_t begin
+			    = martingale_cs_quantile_hdr_bucket_begin(
+				&hdr, i);
+			const uint64_t end
+			    = martingale_cs_quantile_hdr_bucket_end(&hdr, i);
+
+			ASSERT_EQ(begin, expected_begin) << bits << " " << i;
+			ASSERT_LE(begin, end);
+			ASSERT_EQ(index(bits, begin), i);
+			ASSERT_EQ(index(bits, end), i);
+			// Relative width is at most 2^-bits.
+			ASSERT_LE(end - begin, begin >> bits);
+			expected_begin = end + 1;
+		}
+
+		// The last bucket ends at UINT64_MAX.
+		EXPECT_EQ(expected_begin, 0);
+		martingale_cs_quantile_hdr_deinit(&hdr);
+	}
+}
+
+// Bucketed bounds must contain the exact bounds, and stay within a
+// bucket of them.
+TEST(MartingaleCsQuantile, HdrBoundsConservative)
+{
+	std::mt19937_64 rng(4);
+	std::lognormal_distribution<double> dist(10, 3);
+
+	for (double quantile : { 0.0, 0.5, 0.9, 0.999 }) {
+		struct martingale_cs_quantile exact;
+		struct martingale_cs_quantile_hdr hdr;
+		struct martingale_cs_config config;
+		struct martingale_cs_quantile_scale scale;
+
+		martingale_cs_quantile_init(&exact, quantile, 32, -5);
+		ASSERT_EQ(martingale_cs_quantile_hdr_init(
+			      &hdr, MARTINGALE_CS_QUANTILE_HDR_DEFAULT_BITS),
+		    0);
+		martingale_cs_quantile_config_init(&config, 32, -5, 1, 0);
+		martingale_cs_quantile_scale_init(&scale, quantile);
+		for (size_t i = 0; i < 5000; ++i) {
+			const uint64_t x = dist(rng);
+			double lo, hi, hdr_lo, hdr_hi;
+
+			ASSERT_EQ(martingale_cs_quantile_push(&exact, x), 0);
+			martingale_cs_quantile_hdr_push(&hdr, x);
+			martingale_cs_quantile_bounds(&exact, &lo, &hi);
+			martingale_cs_quantile_hdr_bounds(
+			    &hdr, &config, &scale, &hdr_lo, &hdr_hi);
+
+			ASSERT_LE(hdr_lo, lo);
+			ASSERT_GE(hdr_hi, hi);
+			ASSERT_EQ(std::isinf(hdr_lo), std::isinf(lo));
+			ASSERT_EQ(std::isinf(hdr_hi), std::isinf(hi));
+			if (!std::isinf(lo)) {
+				ASSERT_GE(hdr_lo, lo - lo / 32 - 1);
+			}
+
+			if (!std::isinf(hi)) {
+				ASSERT_LE(hdr_hi, hi + hi / 32 + 1);
+			}
+		}
+
+		martingale_cs_quantile_deinit(&exact);
+		martingale_cs_quantile_hdr_deinit(&hdr);
+	}
+}
+
+TEST(MartingaleCsQuantile, HdrPushManyAndMerge)
+{
+	std::mt19937_64 rng(5);
+	struct martingale_cs_quantile_hdr one, many, left, right, other;
+	std::vector<uint64_t> values(10000);
+
+	for (uint64_t &x : values) {
+		x = rng() >> (rng() % 64);
+	}
+
+	ASSERT_EQ(martingale_cs_quantile_hdr_init(&one, 4), 0);
+	ASSERT_EQ(martingale_cs_quantile_hdr_init(&many, 4), 0);
+	ASSERT_EQ(martingale_cs_quantile_hdr_init(&left, 4), 0);
+	ASSERT_EQ(martingale_cs_quantile_hdr_init(&right, 4), 0);
+	ASSERT_EQ(martingale_cs_quantile_hdr_init(&other, 3), 0);
+	for (size_t i = 0; i < values.size(); ++i) {
+		martingale_cs_quantile_hdr_push(&one, values[i]);
+		martingale_cs_quantile_hdr_push(
+		    (i % 3 == 0) ? &left : &right, values[i]);
+	}
+
+	martingale_cs_quantile_hdr_push_many(
+	    &many, values.data(), values.size());
+	EXPECT_EQ(martingale_cs_quantile_hdr_merge(&left, &right), 0);
+	EXPECT_EQ(martingale_cs_quantile_hdr_merge(&left, &other), -1);
+	EXPECT_EQ(many.count, one.count);
+	EXPECT_EQ(left.count, one.count);
+	for (size_t i = 0; i < one.num_buckets; ++i) {
+		ASSERT_EQ(many.counts[i], one.counts[i]);
+		ASSERT_EQ(left.counts[i], one.counts[i]);
+	}
+
+	for (auto *hdr : { &one, &many, &left, &right, &other }) {
+		martingale_cs_quantile_hdr_deinit(hdr);
+	}
+}
+} // namespace
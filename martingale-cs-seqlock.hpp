@@ -0,0 +1,83 @@
+#ifndef MARTINGALE_CS_SEQLOCK_HPP
+#define MARTINGALE_CS_SEQLOCK_HPP
+/*
+ * Single-writer sequence lock for small trivially copyable values,
+ * e.g., a tester's (n, sum) pair.
+ *
+ * The writer bumps a sequence counter to an odd value, stores the
+ * value word by word, and bumps the counter again; readers retry
+ * whenever the counter is odd or changed while they copied the words.
+ * On x86-64, both sides compile to plain loads and stores: writers
+ * never wait, and readers never write to the shared cache line.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace martingale_cs {
+template <typename T> class seqlock {
+	static_assert(std::is_trivially_copyable<T>::value,
+	    "seqlock values are copied word by word");
+
+    public:
+	explicit seqlock(const T &initial = T()) { store(initial); }
+
+	seqlock(const seqlock &) = delete;
+	seqlock &operator=(const seqlock &) = delete;
+
+	/* Only one thread may store at once. */
+	void store(const T &value)
+	{
+		const auto relaxed = std::memory_order_relaxed;
+		const uint64_t seq = seq_.load(relaxed);
+		uint64_t words[kWords] = {};
+
+		std::memcpy(words, &value, sizeof(T));
+		/* Odd sequence numbers mark updates in progress. */
+		seq_.store(seq + 1, relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < kWords; ++i) {
+			words_[i].store(words[i], relaxed);
+		}
+
+		seq_.store(seq + 2, std::memory_order_release);
+	}
+
+	/* Returns a value that was stored at once; safe from any thread. */
+	T load() const
+	{
+		for (;;) {
+			const uint64_t seq
+			    = seq_.load(std::memory_order_acquire);
+			uint64_t words[kWords];
+			T ret;
+
+			for (size_t i = 0; i < kWords; ++i) {
+				words[i] = words_[i].load(
+				    std::memory_order_relaxed);
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if ((seq & 1) == 0
+			    && seq_.load(std::memory_order_relaxed) == seq) {
+				std::memcpy(&ret, words, sizeof(T));
+				return ret;
+			}
+
+			std::this_thread::yield();
+		}
+	}
+
+    private:
+	static constexpr size_t kWords
+	    = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	std::atomic<uint64_t> seq_ { 0 };
+	std::atomic<uint64_t> words_[kWords];
+};
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_SEQLOCK_HPP */
@@ -0,0 +1,274 @@
+#ifndef MARTINGALE_CS_SHARDED_HPP
+#define MARTINGALE_CS_SHARDED_HPP
+/*
+ * Multi-producer sequential test: many threads push observations for
+ * the same test, without sharing a cache line on the hot path.
+ *
+ *   martingale_cs::sharded_tester test(num_workers, 32, -1, 1, log_eps);
+ *   test.start_checker(std::chrono::milliseconds(10));
+ *   ...
+ *   // On worker `i`:
+ *   if (test[i].push(x) != martingale_cs::tester::kUndecided)
+ *           ...
+ *
+ * Each shard lives on its own cache line (the shards are allocated
+ * with `allocate_lines`, so that holds before C++17 too) and only has
+ * one writer, so `push` is a handful of plain loads and stores: no
+ * read-modify-write atomics, and the line never leaves the writer's
+ * cache between checks.  A shard publishes its (n, sum) pair with a
+ * `seqlock`, so the combiner always reads the count and sum of the
+ * same prefix of the shard's observations.
+ *
+ * The combiner (`check`, called on demand or by the background
+ * checker thread) adds up the shards, and compares the total against
+ * the two-sided thresholds for `[lo, hi]`, like `martingale_cs_tester`.
+ *
+ * Why checking at arbitrary snapshot times is fine: shards only
+ * grow, so each snapshot contains the previous one.  Order the
+ * observations by the first snapshot that includes them (and
+ * arbitrarily within a snapshot): every snapshot's (N, S) is then the
+ * count and sum of a prefix of that one sequence.  The confidence
+ * sequence bounds the sums of all prefixes simultaneously, so the
+ * probability that *any* prefix crosses the threshold under the null
+ * is at most `exp(log_eps)`; looking at a subset of the prefixes,
+ * chosen at whatever times, can only lower the false positive rate.
+ * There is no multiple testing penalty for checking often, and no
+ * need to check at every n.
+ *
+ * This argument needs the observations to be i.i.d. and the
+ * interleaving (which observations make it into a snapshot) to not
+ * depend on their own values.  Don't, e.g., hold back large values
+ * and push them later.
+ *
+ * Checking less often only delays detection: once the true sum
+ * crosses, the next check sees it.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include "martingale-cs-cacheline.hpp"
+#include "martingale-cs-seqlock.hpp"
+#include "martingale-cs-tester.hpp"
+
+namespace martingale_cs {
+class sharded_tester {
+    public:
+	struct snapshot {
+		uint64_t n;
+		double sum;
+	};
+
+	/* One producer's observations.  Only one thread may push at once. */
+	class alignas(kCacheLine) shard {
+	    public:
+		/*
+		 * Adds an observation, clipped to `[lo, hi]`, and returns
+		 * the combined status as of the last check.
+		 */
+		tester::decision push(double x)
+		{
+			x = (x < parent_->lo_) ? parent_->lo_ : x;
+			x = (x > parent_->hi_) ? parent_->hi_ : x;
+			n_++;
+			sum_ += x;
+			published_.store({ n_, sum_ });
+			return parent_->status();
+		}
+
+		/* A consistent (n, sum) pair; safe from any thread. */
+		snapshot read() const { return published_.load(); }
+
+	    private:
+		friend class sharded_tester;
+
+		const sharded_tester *parent_ = nullptr;
+		/* The writer's own copy. */
+		uint64_t n_ = 0;
+		double sum_ = 0;
+		seqlock<snapshot> published_;
+	};
+
+	/*
+	 * A two-sided (or one-sided, high) test for observations in
+	 * `[lo, hi]` from up to `num_shards` producers; see
+	 * `martingale_cs_tester_init`.
+	 */
+	sharded_tester(size_t num_shards, uint64_t min_count, double lo,
+	    double hi, double log_eps, bool two_sided = true)
+	    : lo_(lo)
+	    , hi_(hi)
+	    , two_sided_(two_sided)
+	    , num_shards_(num_shards)
+	    , lines_(allocate_lines(kCacheLine + num_shards * sizeof(shard)))
+	    , status_(new (lines_) std::atomic<int>(tester::kUndecided))
+	    , shards_(reinterpret_cast<shard *>(
+		  static_cast<char *>(lines_) + kCacheLine))
+	{
+		if (two_sided) {
+			log_eps += martingale_cs_eq;
+		}
+
+		martingale_cs_config_init_range(
+		    &high_, min_count, lo, hi, log_eps);
+		martingale_cs_config_init_range(
+		    &low_, min_count, -hi, -lo, log_eps);
+		for (size_t i = 0; i < num_shards; ++i) {
+			new (&shards_[i]) shard();
+			shards_[i].parent_ = this;
+		}
+	}
+
+	~sharded_tester()
+	{
+		stop_checker();
+		for (size_t i = 0; i < num_shards_; ++i) {
+			shards_[i].~shard();
+		}
+
+		std::free(lines_);
+	}
+
+	sharded_tester(const sharded_tester &) = delete;
+	sharded_tester &operator=(const sharded_tester &) = delete;
+
+	size_t num_shards() const { return num_shards_; }
+
+	shard &operator[](size_t index) { return shards_[index]; }
+
+	/* The sum of the shards' consistent snapshots. */
+	snapshot read() const
+	{
+		snapshot ret = { 0, 0 };
+
+		for (size_t i = 0; i < num_shards_; ++i) {
+			const snapshot part = shards_[i].read();
+
+			ret.n += part.n;
+			ret.sum += part.sum;
+		}
+
+		return ret;
+	}
+
+	/*
+	 * Combines the shards, compares the total against the
+	 * thresholds, and returns the (sticky) status.
+	 */
+	tester::decision check()
+	{
+		std::lock_guard<std::mutex> lock(check_mutex_);
+		tester::decision ret = status();
+
+		if (ret != tester::kUndecided) {
+			return ret;
+		}
+
+		const snapshot total = read();
+		/* The sum can't cross before `next_check_`. */
+		if (total.n < next_check_) {
+			return ret;
+		}
+
+		if (martingale_cs_config_exceeds(
+			&high_, total.sum, total.n)) {
+			ret = tester::kHigh;
+		} else if (two_sided_
+		    && martingale_cs_config_exceeds(
+			&low_, -total.sum, total.n)) {
+			ret = tester::kLow;
+		}
+
+		if (ret != tester::kUndecided) {
+			status_->store(ret, std::memory_order_relaxed);
+			return ret;
+		}
+
+		next_check_ = martingale_cs_config_next_check(
+		    &high_, total.n, total.sum, hi_);
+		if (two_sided_) {
+			const uint64_t low_next
+			    = martingale_cs_config_next_check(
+				&low_, total.n, -total.sum, -lo_);
+
+			next_check_ = std::min(next_check_, low_next);
+		}
+
+		return ret;
+	}
+
+	tester::decision status() const
+	{
+		return static_cast<tester::decision>(
+		    status_->load(std::memory_order_relaxed));
+	}
+
+	bool decided() const { return status() != tester::kUndecided; }
+
+	/*
+	 * Calls `check` every `period` on a background thread, until
+	 * the test decides, `stop_checker`, or destruction.
+	 */
+	template <typename Rep, typename Period>
+	void start_checker(std::chrono::duration<Rep, Period> period)
+	{
+		stop_checker();
+		stopping_ = false;
+		checker_ = std::thread([this, period] {
+			std::unique_lock<std::mutex> lock(checker_mutex_);
+
+			while (!stopping_ && check() == tester::kUndecided) {
+				stop_.wait_for(lock, period,
+				    [this] { return stopping_; });
+			}
+		});
+	}
+
+	void stop_checker()
+	{
+		if (!checker_.joinable()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(checker_mutex_);
+			stopping_ = true;
+		}
+
+		stop_.notify_all();
+		checker_.join();
+	}
+
+    private:
+	const double lo_;
+	const double hi_;
+	const bool two_sided_;
+	const size_t num_shards_;
+	/*
+	 * One cache line for `status_`, then the shards.  `status_` is
+	 * written by the combiner, and read by every `push`.
+	 */
+	void *const lines_;
+	std::atomic<int> *const status_;
+	shard *const shards_;
+	struct martingale_cs_config high_;
+	struct martingale_cs_config low_;
+
+	std::mutex check_mutex_;
+	uint64_t next_check_ = 0;
+
+	std::mutex checker_mutex_;
+	std::condition_variable stop_;
+	bool stopping_ = false;
+	std::thread checker_;
+};
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_SHARDED_HPP */
@@ -0,0 +1,120 @@
+#include "martingale-cs-sharded.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+// With one shard, checking after every push is the tester's loop.
+TEST(MartingaleCsSharded, MatchesTester)
+{
+	std::mt19937_64 rng(1);
+
+	for (size_t iter = 0; iter < 100; ++iter) {
+		const double p_hi = 0.5 + ((rng() % 21) - 10.0) / 200.0;
+		std::bernoulli_distribution coin(p_hi);
+		martingale_cs::sharded_tester sharded(1, 32, -1, 1, -5);
+		martingale_cs::tester expected(32, -1, 1, -5);
+
+		for (size_t i = 0; i < 20000; ++i) {
+			const double x = coin(rng) ? 1 : -1;
+
+			sharded[0].push(x);
+			ASSERT_EQ(sharded.check(), expected.push(x))
+			    << iter << " " << i;
+		}
+	}
+}
+
+// Each shard owns its cache line(s), even on the heap before C++17.
+TEST(MartingaleCsSharded, ShardsOnTheirOwnLines)
+{
+	std::unique_ptr<martingale_cs::sharded_tester> test(
+	    new martingale_cs::sharded_tester(5, 32, -1, 1, -5));
+
+	for (size_t i = 0; i < test->num_shards(); ++i) {
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(&(*test)[i])
+			% martingale_cs::kCacheLine,
+		    0)
+		    << i;
+	}
+}
+
+// Shards sum to the total, whatever the producer threads do.
+TEST(MartingaleCsSharded, CombinesShards)
+{
+	const size_t kThreads = 8;
+	const size_t kCount = 100000;
+	martingale_cs::sharded_tester test(kThreads, 32, -1, 1, -5);
+	std::vector<std::thread> workers;
+	std::vector<double> sums(kThreads, 0);
+	uint64_t last_n = 0;
+
+	for (size_t i = 0; i < kThreads; ++i) {
+		workers.emplace_back([&, i] {
+			std::mt19937_64 rng(i);
+			std::uniform_real_distribution<double> dist(-2, 2);
+
+			for (size_t j = 0; j < kCount; ++j) {
+				const double x = dist(rng);
+
+				test[i].push(x);
+				sums[i] += std::max(-1.0, std::min(1.0, x));
+			}
+		});
+	}
+
+	// Concurrent snapshots only ever grow.
+	while (last_n < kThreads * kCount) {
+		const auto snapshot = test.read();
+
+		ASSERT_GE(snapshot.n, last_n);
+		last_n = snapshot.n;
+	}
+
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+
+	double expected = 0;
+	for (double sum : sums) {
+		expected += sum;
+	}
+
+	EXPECT_EQ(test.read().n, kThreads * kCount);
+	EXPECT_EQ(test.read().sum, expected);
+}
+
+TEST(MartingaleCsSharded, BackgroundChecker)
+{
+	const size_t kThreads = 4;
+	martingale_cs::sharded_tester test(kThreads, 32, -1, 1, -5);
+	std::vector<std::thread> workers;
+
+	test.start_checker(std::chrono::milliseconds(1));
+	for (size_t i = 0; i < kThreads; ++i) {
+		workers.emplace_back([&, i] {
+			std::mt19937_64 rng(i);
+			std::bernoulli_distribution coin(0.6);
+
+			while (test[i].push(coin(rng) ? 1 : -1)
+			    == martingale_cs::tester::kUndecided) {
+				continue;
+			}
+		});
+	}
+
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+
+	EXPECT_EQ(test.status(), martingale_cs::tester::kHigh);
+	test.stop_checker();
+}
+} // namespace
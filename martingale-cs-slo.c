@@ -0,0 +1,458 @@
+#include "martingale-cs-slo.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MARTINGALE_CS_X86_BATCH 1
+#include <immintrin.h>
+#else
+#define MARTINGALE_CS_X86_BATCH 0
+#endif
+
+void martingale_cs_slo_init(struct martingale_cs_slo *slo, double quantile,
+    double budget, uint64_t min_count, double log_eps)
+{
+	assert(quantile > 0 && quantile < 1.0
+	    && "SLO quantile is a fraction in (0, 1). Was a percentile "
+	       "passed in without dividing by 100?");
+
+	slo->n = 0;
+	slo->exceed = 0;
+	slo->next_check = 0;
+	slo->budget = budget;
+	slo->status = MARTINGALE_CS_SLO_UNDECIDED;
+	slo->isa = martingale_cs_batch_isa();
+	martingale_cs_quantile_config_init(
+	    &slo->config, min_count, log_eps, 1, 0);
+	martingale_cs_quantile_scale_init(&slo->scale, quantile);
+	martingale_cs_slo_check(slo);
+}
+
+/*
+ * Returns the earliest n at which `sum` could reach `scale` times the
+ * config's threshold, when each sample increases `sum` by at most
+ * `max_step`.  We pad the sum a little, to cover the rounding error
+ * in the rank computations: checking early is always safe.
+ */
+static uint64_t scaled_next_check(const struct martingale_cs_config *config,
+    uint64_t n, double sum, double max_step, double scale)
+{
+	const double padded = sum + ((double)n + 1) * 0x1p-40;
+
+	return martingale_cs_config_next_check(config, n,
+	    nextafter(padded / scale, HUGE_VAL),
+	    nextafter(max_step / scale, HUGE_VAL));
+}
+
+/*
+ * Returns the status of an SLO with `exceed` out of `n` samples over
+ * budget, given the quantile's slops at `n`.  Stores the earliest n
+ * at which an undecided SLO could decide in `next_check`.
+ */
+static int decide(const struct martingale_cs_config *config,
+    const struct martingale_cs_quantile_scale *scale, uint64_t n,
+    uint64_t exceed, double slop_lo, double slop_hi,
+    uint64_t *next_check)
+{
+	const double quantile = scale->quantile;
+	const uint64_t within = n - exceed;
+
+	*next_check = UINT64_MAX;
+	/* The quantile is at least the sample at the lower rank... */
+	if (floor(quantile * n + slop_lo) >= (double)within) {
+		return MARTINGALE_CS_SLO_VIOLATED;
+	}
+
+	/* ... and at most the sample at the upper rank. */
+	if (ceil(quantile * n + slop_hi) < (double)within) {
+		return MARTINGALE_CS_SLO_SATISFIED;
+	}
+
+	/*
+	 * With `slop_lo = -1 - lo_scale t(n)`, we find a violation once
+	 * `lo_scale t(n) <= exceed - (1 - quantile) n - 1`.  The
+	 * right-hand side increases by at most `quantile` per sample
+	 * (when the sample exceeds the budget).  Symmetrically, the SLO
+	 * is satisfied once `hi_scale t(n) <= (1 - quantile) n - exceed -
+	 * 2`, which increases by at most `1 - quantile` per sample.
+	 */
+	const double excess = (double)exceed - (1 - quantile) * (double)n - 1;
+	const double slack = (1 - quantile) * (double)n - (double)exceed - 2;
+	const uint64_t violate_check = scaled_next_check(
+	    config, n, excess, quantile, scale->lo_scale);
+	const uint64_t satisfy_check = scaled_next_check(
+	    config, n, slack, 1 - quantile, scale->hi_scale);
+
+	*next_check
+	    = (violate_check < satisfy_check) ? violate_check : satisfy_check;
+	return MARTINGALE_CS_SLO_UNDECIDED;
+}
+
+void martingale_cs_slo_check(struct martingale_cs_slo *slo)
+{
+	double slop_lo, slop_hi;
+
+	if (slo->status != MARTINGALE_CS_SLO_UNDECIDED) {
+		slo->next_check = UINT64_MAX;
+		return;
+	}
+
+	martingale_cs_quantile_intervals(
+	    &slo->config, &slo->scale, 1, slo->n, &slop_lo, &slop_hi);
+	slo->status = decide(&slo->config, &slo->scale, slo->n, slo->exceed,
+	    slop_lo, slop_hi, &slo->next_check);
+}
+
+struct martingale_cs_slo_set_entry {
+	/* Index in `budgets` and `exceed`. */
+	size_t budget;
+	/* Index in the specs and `status`. */
+	size_t slo;
+};
+
+static int compare_double(const void *x, const void *y)
+{
+	const double a = *(const double *)x;
+	const double b = *(const double *)y;
+
+	return (a > b) - (a < b);
+}
+
+/*
+ * Returns the number of values in sorted `budgets` strictly less than
+ * `x`, without data-dependent branches.
+ */
+static inline size_t budget_rank(
+    const double *budgets, size_t count, double x)
+{
+	size_t pos = 0;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	/* The rank is always in [pos, pos + count]. */
+	while (count > 1) {
+		const size_t half = count / 2;
+
+		pos = (budgets[pos + half - 1] < x) ? pos + half : pos;
+		count -= half;
+	}
+
+	return pos + (budgets[pos] < x);
+}
+
+static void slo_set_check(struct martingale_cs_slo_set *set)
+{
+	uint64_t next = UINT64_MAX;
+
+	for (size_t i = 0; i < set->num_configs; i++) {
+		const struct martingale_cs_config *config = &set->configs[i];
+		const size_t begin = set->begin[i];
+		const size_t end = set->begin[i + 1];
+
+		/* One threshold evaluation for all the config's SLOs. */
+		martingale_cs_quantile_intervals(config, set->scales + begin,
+		    end - begin, set->n, set->slop_lo + begin,
+		    set->slop_hi + begin);
+		for (size_t j = begin; j < end; j++) {
+			const struct martingale_cs_slo_set_entry *entry
+			    = &set->entries[j];
+			uint64_t slo_next;
+
+			if (set->status[entry->slo]
+			    != MARTINGALE_CS_SLO_UNDECIDED) {
+				continue;
+			}
+
+			set->status[entry->slo] = decide(config,
+			    &set->scales[j], set->n,
+			    set->exceed[entry->budget], set->slop_lo[j],
+			    set->slop_hi[j], &slo_next);
+			if (set->status[entry->slo]
+			    != MARTINGALE_CS_SLO_UNDECIDED) {
+				set->num_undecided--;
+			}
+
+			next = (slo_next < next) ? slo_next : next;
+		}
+	}
+
+	set->next_check = next;
+}
+
+int martingale_cs_slo_set_init(struct martingale_cs_slo_set *set,
+    const struct martingale_cs_slo_spec *specs, size_t count)
+{
+	/* Config index for each spec, and first spec for each config. */
+	size_t *config_of = calloc(2 * count + 1, sizeof(size_t));
+	size_t *config_spec;
+
+	memset(set, 0, sizeof(*set));
+	set->num_slos = count;
+	set->num_undecided = count;
+	/* + 1: calloc(0) may return NULL. */
+	set->budgets = calloc(count + 1, sizeof(double));
+	set->exceed = calloc(count + 1, sizeof(uint64_t));
+	set->counts = calloc(count + 1, sizeof(uint64_t));
+	set->configs = calloc(count + 1, sizeof(struct martingale_cs_config));
+	set->begin = calloc(count + 1, sizeof(size_t));
+	set->scales = calloc(
+	    count + 1, sizeof(struct martingale_cs_quantile_scale));
+	set->entries = calloc(
+	    count + 1, sizeof(struct martingale_cs_slo_set_entry));
+	set->slop_lo = calloc(count + 1, sizeof(double));
+	set->slop_hi = calloc(count + 1, sizeof(double));
+	set->status = calloc(count + 1, sizeof(int));
+	if (config_of == NULL || set->budgets == NULL || set->exceed == NULL
+	    || set->counts == NULL || set->configs == NULL
+	    || set->begin == NULL || set->scales == NULL
+	    || set->entries == NULL || set->slop_lo == NULL
+	    || set->slop_hi == NULL || set->status == NULL) {
+		free(config_of);
+		martingale_cs_slo_set_deinit(set);
+		return -1;
+	}
+
+	config_spec = config_of + count;
+	for (size_t i = 0; i < count; i++) {
+		assert(!isnan(specs[i].budget) && "NaN budget.");
+		set->budgets[i] = specs[i].budget;
+	}
+
+	qsort(set->budgets, count, sizeof(double), compare_double);
+	for (size_t i = 0; i < count; i++) {
+		const double budget = set->budgets[i];
+
+		if (set->num_budgets == 0
+		    || budget != set->budgets[set->num_budgets - 1]) {
+			set->budgets[set->num_budgets++] = budget;
+		}
+	}
+
+	/* Dedup configs; there are usually only a few. */
+	for (size_t i = 0; i < count; i++) {
+		size_t config = 0;
+
+		while (config < set->num_configs
+		    && (specs[config_spec[config]].min_count
+			       != specs[i].min_count
+			|| specs[config_spec[config]].log_eps
+			    != specs[i].log_eps)) {
+			config++;
+		}
+
+		if (config == set->num_configs) {
+			config_spec[set->num_configs++] = i;
+			martingale_cs_quantile_config_init(
+			    &set->configs[config], specs[i].min_count,
+			    specs[i].log_eps, 1, 0);
+		}
+
+		config_of[i] = config;
+		set->begin[config + 1]++;
+	}
+
+	/* Counting sort of the SLOs by config. */
+	for (size_t i = 0; i < set->num_configs; i++) {
+		set->begin[i + 1] += set->begin[i];
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		/* Use `begin[config]` as a cursor, and shift back below. */
+		const size_t j = set->begin[config_of[i]]++;
+
+		assert(specs[i].quantile > 0 && specs[i].quantile < 1.0
+		    && "SLO quantile is a fraction in (0, 1).");
+		martingale_cs_quantile_scale_init(
+		    &set->scales[j], specs[i].quantile);
+		set->entries[j].budget = budget_rank(
+		    set->budgets, set->num_budgets, specs[i].budget);
+		set->entries[j].slo = i;
+	}
+
+	memmove(set->begin + 1, set->begin,
+	    set->num_configs * sizeof(size_t));
+	set->begin[0] = 0;
+	free(config_of);
+	slo_set_check(set);
+	return 0;
+}
+
+void martingale_cs_slo_set_deinit(struct martingale_cs_slo_set *set)
+{
+	free(set->budgets);
+	free(set->exceed);
+	free(set->counts);
+	free(set->configs);
+	free(set->begin);
+	free(set->scales);
+	free(set->entries);
+	free(set->slop_lo);
+	free(set->slop_hi);
+	free(set->status);
+	memset(set, 0, sizeof(*set));
+}
+
+size_t martingale_cs_slo_set_push_many(struct martingale_cs_slo_set *set,
+    const double *latencies, size_t count)
+{
+	const double *budgets = set->budgets;
+	const size_t num_budgets = set->num_budgets;
+	uint64_t *counts = set->counts;
+
+	while (count > 0) {
+		const uint64_t until_check = set->next_check - set->n;
+		const size_t chunk
+		    = (until_check < count) ? (size_t)until_check : count;
+		uint64_t above = 0;
+
+		assert(until_check > 0 && "Observation count overflow.");
+		for (size_t i = 0; i < chunk; i++) {
+			const double x = latencies[i];
+
+			counts[budget_rank(budgets, num_budgets, x)]++;
+		}
+
+		/* A sample greater than j budgets exceeds budgets[0, j). */
+		for (size_t j = num_budgets; j > 0; j--) {
+			above += counts[j];
+			counts[j] = 0;
+			set->exceed[j - 1] += above;
+		}
+
+		counts[0] = 0;
+		set->n += chunk;
+		latencies += chunk;
+		count -= chunk;
+		if (set->n >= set->next_check) {
+			slo_set_check(set);
+		}
+	}
+
+	return set->num_undecided;
+}
+
+static uint64_t count_exceed_scalar(
+    const double *latencies, size_t count, double budget)
+{
+	uint64_t ret = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		ret += (latencies[i] > budget);
+	}
+
+	return ret;
+}
+
+#if MARTINGALE_CS_X86_BATCH
+/*
+ * The vector kernels compare with `_CMP_GT_OQ`, which is false for
+ * NaN, like the scalar `>`.
+ */
+__attribute__((target("avx2"))) static uint64_t count_exceed_avx2(
+    const double *latencies, size_t count, double budget)
+{
+	const __m256d limit = _mm256_set1_pd(budget);
+	/* Each lane subtracts its all-ones (-1) compare masks. */
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		const __m256d x0 = _mm256_loadu_pd(latencies + i);
+		const __m256d x1 = _mm256_loadu_pd(latencies + i + 4);
+
+		const __m256d gt0 = _mm256_cmp_pd(x0, limit, _CMP_GT_OQ);
+		const __m256d gt1 = _mm256_cmp_pd(x1, limit, _CMP_GT_OQ);
+
+		acc0 = _mm256_sub_epi64(acc0, _mm256_castpd_si256(gt0));
+		acc1 = _mm256_sub_epi64(acc1, _mm256_castpd_si256(gt1));
+	}
+
+	uint64_t lanes[4];
+	_mm256_storeu_si256(
+	    (__m256i *)lanes, _mm256_add_epi64(acc0, acc1));
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+	    + count_exceed_scalar(latencies + i, count - i, budget);
+}
+
+__attribute__((target("avx512f"))) static uint64_t count_exceed_avx512(
+    const double *latencies, size_t count, double budget)
+{
+	const __m512d limit = _mm512_set1_pd(budget);
+	uint64_t ret = 0;
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		const __m512d x0 = _mm512_loadu_pd(latencies + i);
+		const __m512d x1 = _mm512_loadu_pd(latencies + i + 8);
+		const unsigned mask
+		    = (unsigned)_mm512_cmp_pd_mask(x0, limit, _CMP_GT_OQ)
+		    | ((unsigned)_mm512_cmp_pd_mask(x1, limit, _CMP_GT_OQ)
+			<< 8);
+
+		ret += (uint64_t)__builtin_popcount(mask);
+	}
+
+	return ret + count_exceed_scalar(latencies + i, count - i, budget);
+}
+#endif /* MARTINGALE_CS_X86_BATCH */
+
+/* `isa` must be supported. */
+static uint64_t count_exceed(
+    int isa, const double *latencies, size_t count, double budget)
+{
+	switch (isa) {
+#if MARTINGALE_CS_X86_BATCH
+	case MARTINGALE_CS_ISA_AVX512:
+		return count_exceed_avx512(latencies, count, budget);
+	case MARTINGALE_CS_ISA_AVX2:
+		return count_exceed_avx2(latencies, count, budget);
+#endif
+	default:
+		return count_exceed_scalar(latencies, count, budget);
+	}
+}
+
+int martingale_cs_slo_push_many(
+    struct martingale_cs_slo *slo, const double *latencies, size_t count)
+{
+	while (count > 0) {
+		/* `n < next_check` after every check. */
+		const uint64_t until_check = slo->next_check - slo->n;
+		const size_t chunk
+		    = (until_check < count) ? (size_t)until_check : count;
+
+		assert(until_check > 0 && "Observation count overflow.");
+		slo->exceed += count_exceed(
+		    slo->isa, latencies, chunk, slo->budget);
+		slo->n += chunk;
+		latencies += chunk;
+		count -= chunk;
+		if (slo->n >= slo->next_check) {
+			martingale_cs_slo_check(slo);
+		}
+	}
+
+	return slo->status;
+}
+
+uint64_t martingale_cs_count_exceed_isa(
+    int isa, const double *latencies, size_t count, double budget)
+{
+	const int best = martingale_cs_batch_isa();
+
+	return count_exceed(
+	    (isa > best) ? best : isa, latencies, count, budget);
+}
+
+uint64_t martingale_cs_count_exceed(
+    const double *latencies, size_t count, double budget)
+{
+	return count_exceed(
+	    martingale_cs_batch_isa(), latencies, count, budget);
+}
@@ -0,0 +1,206 @@
+#ifndef MARTINGALE_CS_SLO_H
+#define MARTINGALE_CS_SLO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "martingale-cs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sequential test for a latency SLO of the form "the `quantile`th
+ * quantile of the latency distribution is at most `budget`", e.g.,
+ * p99 <= 5 ms.
+ *
+ * The monitor doesn't keep observations: it only counts the samples
+ * that exceed the budget.  After n samples, k of which exceed the
+ * budget, the `martingale_cs_quantile_slop_lo` and `_hi` rank
+ * interval for the quantile is `[floor(quantile n + slop_lo),
+ * ceil(quantile n + slop_hi)]`, and the sample at rank r (0-indexed)
+ * is within budget iff `r < n - k`.  The SLO is violated once the
+ * lower rank falls on a sample over budget, and satisfied once the
+ * upper rank falls on a sample within budget.
+ *
+ * Like `martingale_cs_tester`, the monitor caches the earliest n at
+ * which the decision could change, so most pushes are a compare and
+ * two increments, and the decision sticks once made.  The decision
+ * is wrong with probability at most `exp(log_eps)`, however many
+ * times we check.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_slo {
+	uint64_t n;
+	/* Number of samples strictly greater than `budget`. */
+	uint64_t exceed;
+	/* Call `martingale_cs_slo_check` once `n >= next_check`. */
+	uint64_t next_check;
+	double budget;
+	int status;
+	/* `martingale_cs_batch_isa()` at init. */
+	int isa;
+	struct martingale_cs_config config;
+	struct martingale_cs_quantile_scale scale;
+};
+
+/* Not enough data (yet). */
+#define MARTINGALE_CS_SLO_UNDECIDED 0
+/* The quantile is greater than the budget. */
+#define MARTINGALE_CS_SLO_VIOLATED 1
+/* The quantile is at most the budget. */
+#define MARTINGALE_CS_SLO_SATISFIED -1
+
+/*
+ * Initialises `slo` for `quantile` in (0, 1) and `budget`, with a
+ * `1 - exp(log_eps)` confidence interval; see
+ * `martingale_cs_quantile_slop` for `min_count` and `log_eps`.
+ */
+void martingale_cs_slo_init(struct martingale_cs_slo *slo, double quantile,
+    double budget, uint64_t min_count, double log_eps);
+
+/*
+ * Compares the counts against the quantile's rank interval, updates
+ * the status, and refreshes `next_check`.  `martingale_cs_slo_push`
+ * calls this when needed.
+ */
+void martingale_cs_slo_check(struct martingale_cs_slo *slo);
+
+/*
+ * Adds a sample and returns the monitor's status.  NaN samples count
+ * as within budget.
+ */
+static inline int martingale_cs_slo_push(
+    struct martingale_cs_slo *slo, double latency)
+{
+	slo->exceed += (latency > slo->budget);
+	if (++slo->n >= slo->next_check) {
+		martingale_cs_slo_check(slo);
+	}
+
+	return slo->status;
+}
+
+/*
+ * Adds `count` samples and returns the monitor's status, like
+ * calling `martingale_cs_slo_push` on each sample.  The exceedances
+ * are counted with vector compares, and the thresholds only checked
+ * at `next_check`.
+ */
+int martingale_cs_slo_push_many(
+    struct martingale_cs_slo *slo, const double *latencies, size_t count);
+
+/*
+ * Returns `MARTINGALE_CS_SLO_UNDECIDED`, `MARTINGALE_CS_SLO_VIOLATED`
+ * or `MARTINGALE_CS_SLO_SATISFIED`.
+ */
+static inline int martingale_cs_slo_status(
+    const struct martingale_cs_slo *slo)
+{
+	return slo->status;
+}
+
+/*
+ * Monitor for many SLOs on the same stream of samples, e.g., p50,
+ * p90 and p99 each against a few budgets.
+ *
+ * The set keeps one over-budget counter per distinct budget.  Each
+ * sample takes a branch-free binary search over the sorted budgets,
+ * and one increment; the counters are then updated with a suffix sum
+ * at the end of each chunk, so the cost per sample is `O(log
+ * budgets)`, independently of the number of SLOs.
+ *
+ * SLOs with the same `min_count` and `log_eps` share a config, and
+ * each check evaluates the threshold once per distinct config, like
+ * `martingale_cs_quantile_intervals`.  Each SLO's decision holds with
+ * probability `1 - exp(log_eps)`; to make all the decisions hold
+ * simultaneously, subtract `log(count)` from each `log_eps`.
+ *
+ * The set only checks when some undecided SLO could decide, and each
+ * SLO decides at the same n as a `martingale_cs_slo` would.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_slo_spec {
+	double quantile;
+	double budget;
+	uint64_t min_count;
+	double log_eps;
+};
+
+struct martingale_cs_slo_set_entry;
+
+struct martingale_cs_slo_set {
+	uint64_t n;
+	uint64_t next_check;
+	size_t num_slos;
+	size_t num_undecided;
+	/* Distinct budgets, in increasing order. */
+	double *budgets;
+	size_t num_budgets;
+	/* `exceed[i]` counts samples strictly greater than `budgets[i]`. */
+	uint64_t *exceed;
+	/*
+	 * Scratch for a chunk: `counts[j]` counts samples greater than
+	 * exactly `j` budgets.
+	 */
+	uint64_t *counts;
+	struct martingale_cs_config *configs;
+	size_t num_configs;
+	/*
+	 * The rest is grouped by config: config `i` covers `[begin[i],
+	 * begin[i + 1])`.
+	 */
+	size_t *begin;
+	struct martingale_cs_quantile_scale *scales;
+	struct martingale_cs_slo_set_entry *entries;
+	double *slop_lo;
+	double *slop_hi;
+	/* Status for each SLO, in the order of the specs. */
+	int *status;
+};
+
+/*
+ * Initialises `set` for the `count` SLOs in `specs`, each as for
+ * `martingale_cs_slo_init`.  Returns 0 on success, and -1 if memory
+ * allocation failed.
+ */
+int martingale_cs_slo_set_init(struct martingale_cs_slo_set *set,
+    const struct martingale_cs_slo_spec *specs, size_t count);
+
+void martingale_cs_slo_set_deinit(struct martingale_cs_slo_set *set);
+
+/*
+ * Adds `count` samples, and returns the number of SLOs that are still
+ * undecided.
+ */
+size_t martingale_cs_slo_set_push_many(struct martingale_cs_slo_set *set,
+    const double *latencies, size_t count);
+
+/* Returns the status of the `index`th SLO (in the order of the specs). */
+static inline int martingale_cs_slo_set_status(
+    const struct martingale_cs_slo_set *set, size_t index)
+{
+	return set->status[index];
+}
+
+/*
+ * Returns the number of samples in `latencies` strictly greater than
+ * `budget`, with the widest `MARTINGALE_CS_ISA_*` kernel available.
+ */
+uint64_t martingale_cs_count_exceed(
+    const double *latencies, size_t count, double budget);
+
+/*
+ * Same, with a specific `MARTINGALE_CS_ISA_*` kernel, or the scalar
+ * one if the CPU doesn't support it.
+ */
+uint64_t martingale_cs_count_exceed_isa(
+    int isa, const double *latencies, size_t count, double budget);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* !MARTINGALE_CS_SLO_H */
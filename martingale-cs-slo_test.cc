@@ -0,0 +1,248 @@
+#include "martingale-cs-slo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+// Checks the SLO against the quantile slops after every sample, and
+// returns the count and status of the first decision, or (0,
+// undecided).
+std::pair<uint64_t, int> NaiveDecision(const std::vector<double> &xs,
+    double quantile, double budget, uint64_t min_count, double log_eps)
+{
+	uint64_t exceed = 0;
+
+	for (size_t i = 0; i < xs.size(); ++i) {
+		const uint64_t n = i + 1;
+		double slop_lo, slop_hi;
+
+		exceed += xs[i] > budget;
+		martingale_cs_quantile_interval(
+		    quantile, n, min_count, log_eps, &slop_lo, &slop_hi);
+		if (std::floor(quantile * n + slop_lo) >= n - exceed) {
+			return { n, MARTINGALE_CS_SLO_VIOLATED };
+		}
+
+		if (std::ceil(quantile * n + slop_hi) < n - exceed) {
+			return { n, MARTINGALE_CS_SLO_SATISFIED };
+		}
+	}
+
+	return { 0, MARTINGALE_CS_SLO_UNDECIDED };
+}
+
+// Skipping checks until `next_check` must never delay a decision.
+TEST(MartingaleCsSlo, MatchesNaiveLoop)
+{
+	std::mt19937_64 rng(1);
+	std::exponential_distribution<double> dist(1.0);
+	size_t decided = 0;
+
+	for (size_t iter = 0; iter < 200; ++iter) {
+		const double quantile = (rng() % 999 + 1) / 1000.0;
+		// The true quantile, nudged by up to 10% either way.
+		const double budget = -std::log1p(-quantile)
+		    * (1 + ((rng() % 21) - 10.0) / 100.0);
+		std::vector<double> xs(20000);
+		struct martingale_cs_slo slo;
+
+		for (double &x : xs) {
+			x = dist(rng);
+		}
+
+		const auto expected
+		    = NaiveDecision(xs, quantile, budget, 32, -5);
+		decided += expected.first != 0;
+		martingale_cs_slo_init(&slo, quantile, budget, 32, -5);
+		for (size_t i = 0; i < xs.size(); ++i) {
+			const int status
+			    = martingale_cs_slo_push(&slo, xs[i]);
+
+			if (i + 1 < expected.first || expected.first == 0) {
+				ASSERT_EQ(status, MARTINGALE_CS_SLO_UNDECIDED)
+				    << iter << " " << i;
+			} else {
+				ASSERT_EQ(status, expected.second)
+				    << iter << " " << i;
+			}
+		}
+	}
+
+	// Make sure the test exercises decisions.
+	EXPECT_GT(decided, 50);
+}
+
+TEST(MartingaleCsSlo, PushManyMatchesPush)
+{
+	std::mt19937_64 rng(2);
+	std::exponential_distribution<double> dist(1.0);
+
+	for (size_t iter = 0; iter < 50; ++iter) {
+		const double budget = 3.5 + (rng() % 100) / 50.0;
+		std::vector<double> xs(10000);
+		struct martingale_cs_slo one, many;
+
+		for (double &x : xs) {
+			x = dist(rng);
+		}
+
+		martingale_cs_slo_init(&one, 0.99, budget, 100, -3);
+		martingale_cs_slo_init(&many, 0.99, budget, 100, -3);
+		for (size_t begin = 0; begin < xs.size();) {
+			const size_t end
+			    = std::min(xs.size(), begin + rng() % 1000);
+
+			for (size_t i = begin; i < end; ++i) {
+				martingale_cs_slo_push(&one, xs[i]);
+			}
+
+			ASSERT_EQ(martingale_cs_slo_push_many(
+				      &many, xs.data() + begin, end - begin),
+			    martingale_cs_slo_status(&one));
+			if (one.status == MARTINGALE_CS_SLO_UNDECIDED) {
+				ASSERT_EQ(many.n, one.n);
+				ASSERT_EQ(many.exceed, one.exceed);
+			}
+
+			begin = end;
+		}
+	}
+}
+
+TEST(MartingaleCsSlo, Decides)
+{
+	std::mt19937_64 rng(3);
+	std::exponential_distribution<double> dist(1.0);
+	// p99 of Exp(1) is ~4.6.
+	struct martingale_cs_slo loose, tight;
+	int loose_status = MARTINGALE_CS_SLO_UNDECIDED;
+	int tight_status = MARTINGALE_CS_SLO_UNDECIDED;
+
+	martingale_cs_slo_init(&loose, 0.99, 6, 32, std::log(1e-3));
+	martingale_cs_slo_init(&tight, 0.99, 3.5, 32, std::log(1e-3));
+	for (size_t i = 0; i < 1000000; ++i) {
+		const double x = dist(rng);
+
+		loose_status = martingale_cs_slo_push(&loose, x);
+		tight_status = martingale_cs_slo_push(&tight, x);
+	}
+
+	EXPECT_EQ(loose_status, MARTINGALE_CS_SLO_SATISFIED);
+	EXPECT_EQ(tight_status, MARTINGALE_CS_SLO_VIOLATED);
+}
+
+TEST(MartingaleCsSlo, CountExceedKernelsMatch)
+{
+	std::mt19937_64 rng(4);
+	std::uniform_real_distribution<double> dist(0, 10);
+	std::vector<double> xs(1000);
+
+	for (double &x : xs) {
+		x = dist(rng);
+	}
+
+	xs[3] = std::numeric_limits<double>::quiet_NaN();
+	xs[17] = std::numeric_limits<double>::infinity();
+	xs[18] = 5;
+	for (size_t count : { 0, 1, 7, 8, 15, 16, 17, 999, 1000 }) {
+		uint64_t expected = 0;
+
+		for (size_t i = 0; i < count; ++i) {
+			expected += xs[i] > 5;
+		}
+
+		for (int isa : { MARTINGALE_CS_ISA_SCALAR,
+			 MARTINGALE_CS_ISA_AVX2, MARTINGALE_CS_ISA_AVX512 }) {
+			EXPECT_EQ(martingale_cs_count_exceed_isa(
+				      isa, xs.data(), count, 5),
+			    expected)
+			    << count << " " << isa;
+		}
+	}
+}
+
+// Each SLO in a set must decide at the same n as a standalone monitor.
+TEST(MartingaleCsSlo, SetMatchesSlo)
+{
+	std::mt19937_64 rng(5);
+	std::exponential_distribution<double> dist(1.0);
+
+	for (size_t iter = 0; iter < 20; ++iter) {
+		std::vector<struct martingale_cs_slo_spec> specs;
+		std::vector<struct martingale_cs_slo> slos;
+		std::vector<double> xs(20000);
+		struct martingale_cs_slo_set set;
+
+		for (size_t i = 0; i < 1 + rng() % 40; ++i) {
+			const double quantile = (rng() % 99 + 1) / 100.0;
+			// A few distinct budgets, shared between SLOs.
+			const double budget = -std::log1p(-quantile)
+			    * (0.9 + (rng() % 5) / 20.0);
+			const uint64_t min_count = (rng() % 2) ? 32 : 100;
+			const double log_eps = (rng() % 2) ? -5 : -3;
+
+			specs.push_back(
+			    { quantile, budget, min_count, log_eps });
+			slos.emplace_back();
+			martingale_cs_slo_init(&slos.back(), quantile, budget,
+			    min_count, log_eps);
+		}
+
+		specs.push_back(specs.front());
+		slos.push_back(slos.front());
+		for (double &x : xs) {
+			x = dist(rng);
+		}
+
+		ASSERT_EQ(martingale_cs_slo_set_init(
+			      &set, specs.data(), specs.size()),
+		    0);
+		for (size_t begin = 0; begin < xs.size();) {
+			const size_t end
+			    = std::min(xs.size(), begin + rng() % 500);
+			size_t undecided = 0;
+
+			for (auto &slo : slos) {
+				for (size_t i = begin; i < end; ++i) {
+					martingale_cs_slo_push(&slo, xs[i]);
+				}
+
+				undecided += martingale_cs_slo_status(&slo)
+				    == MARTINGALE_CS_SLO_UNDECIDED;
+			}
+
+			ASSERT_EQ(martingale_cs_slo_set_push_many(
+				      &set, xs.data() + begin, end - begin),
+			    undecided);
+			for (size_t i = 0; i < slos.size(); ++i) {
+				const int status
+				    = martingale_cs_slo_set_status(&set, i);
+
+				ASSERT_EQ(status,
+				    martingale_cs_slo_status(&slos[i]))
+				    << iter << " " << i << " " << end;
+			}
+
+			begin = end;
+		}
+
+		martingale_cs_slo_set_deinit(&set);
+	}
+}
+
+TEST(MartingaleCsSlo, EmptySet)
+{
+	struct martingale_cs_slo_set set;
+	const double xs[] = { 1, 2, 3 };
+
+	ASSERT_EQ(martingale_cs_slo_set_init(&set, nullptr, 0), 0);
+	EXPECT_EQ(martingale_cs_slo_set_push_many(&set, xs, 3), 0);
+	martingale_cs_slo_set_deinit(&set);
+}
+} // namespace
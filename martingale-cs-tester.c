@@ -0,0 +1,188 @@
+#include "martingale-cs-tester.h"
+
+#include <assert.h>
+#include <math.h>
+
+void martingale_cs_tester_init(struct martingale_cs_tester *tester,
+    uint64_t min_count, double lo, double hi, double log_eps,
+    int two_sided)
+{
+	assert(lo <= hi && "Empty range.");
+
+	tester->sum = 0;
+	tester->n = 0;
+	tester->next_check = 0;
+	tester->status = MARTINGALE_CS_TESTER_UNDECIDED;
+	tester->two_sided = two_sided;
+	tester->lo = lo;
+	tester->hi = hi;
+
+	if (two_sided) {
+		log_eps += martingale_cs_eq;
+	}
+
+	martingale_cs_config_init_range(
+	    &tester->high, min_count, lo, hi, log_eps);
+	/* The low tail is the high tail of -x, in [-hi, -lo]. */
+	martingale_cs_config_init_range(
+	    &tester->low, min_count, -hi, -lo, log_eps);
+	martingale_cs_tester_check(tester);
+}
+
+void martingale_cs_tester_check(struct martingale_cs_tester *tester)
+{
+	const double sum = tester->sum;
+	const uint64_t n = tester->n;
+	uint64_t next;
+
+	if (tester->status != MARTINGALE_CS_TESTER_UNDECIDED) {
+		tester->next_check = UINT64_MAX;
+		return;
+	}
+
+	if (martingale_cs_config_exceeds(&tester->high, sum, n)) {
+		tester->status = MARTINGALE_CS_TESTER_HIGH;
+		tester->next_check = UINT64_MAX;
+		return;
+	}
+
+	if (tester->two_sided
+	    && martingale_cs_config_exceeds(&tester->low, -sum, n)) {
+		tester->status = MARTINGALE_CS_TESTER_LOW;
+		tester->next_check = UINT64_MAX;
+		return;
+	}
+
+	next = martingale_cs_config_next_check(
+	    &tester->high, n, sum, tester->hi);
+	if (tester->two_sided) {
+		const uint64_t low_next = martingale_cs_config_next_check(
+		    &tester->low, n, -sum, -tester->lo);
+
+		next = (low_next < next) ? low_next : next;
+	}
+
+	tester->next_check = next;
+}
+
+int martingale_cs_tester_push_many(
+    struct martingale_cs_tester *tester, const double *xs, size_t count)
+{
+	const double lo = tester->lo;
+	const double hi = tester->hi;
+
+	while (count > 0) {
+		/* `n < next_check` after every check. */
+		const uint64_t until_check = tester->next_check - tester->n;
+		const size_t chunk
+		    = (until_check < count) ? (size_t)until_check : count;
+		double sum = tester->sum;
+
+		assert(until_check > 0 && "Observation count overflow.");
+		for (size_t i = 0; i < chunk; i++) {
+			double x = xs[i];
+
+			x = (x < lo) ? lo : x;
+			x = (x > hi) ? hi : x;
+			sum += x;
+		}
+
+		tester->sum = sum;
+		tester->n += chunk;
+		xs += chunk;
+		count -= chunk;
+		if (tester->n >= tester->next_check) {
+			martingale_cs_tester_check(tester);
+		}
+	}
+
+	return tester->status;
+}
+
+/* The first checkpoint after `checkpoint`. */
+static uint64_t next_checkpoint(uint64_t checkpoint, double ratio)
+{
+	const double next = ceil(ratio * (double)checkpoint);
+
+	if (checkpoint == UINT64_MAX || !(next < 0x1p64)) {
+		return UINT64_MAX;
+	}
+
+	return ((uint64_t)next > checkpoint) ? (uint64_t)next
+					      : checkpoint + 1;
+}
+
+static void geometric_schedule(
+    struct martingale_cs_geometric_tester *tester, uint64_t checkpoint)
+{
+	tester->checkpoint = checkpoint;
+	tester->high_threshold
+	    = martingale_cs_config_threshold(&tester->high, checkpoint);
+	tester->low_threshold = HUGE_VAL;
+	if (tester->two_sided) {
+		tester->low_threshold = martingale_cs_config_threshold(
+		    &tester->low, checkpoint);
+	}
+}
+
+void martingale_cs_geometric_tester_init(
+    struct martingale_cs_geometric_tester *tester, uint64_t min_count,
+    double lo, double hi, double log_eps, int two_sided, double ratio)
+{
+	assert(lo <= hi && "Empty range.");
+	assert(ratio > 1 && "Checkpoints must grow.");
+
+	tester->sum = 0;
+	tester->n = 0;
+	tester->ratio = ratio;
+	tester->status = MARTINGALE_CS_TESTER_UNDECIDED;
+	tester->two_sided = two_sided;
+	tester->lo = lo;
+	tester->hi = hi;
+
+	if (two_sided) {
+		log_eps += martingale_cs_eq;
+	}
+
+	martingale_cs_config_init_range(
+	    &tester->high, min_count, lo, hi, log_eps);
+	martingale_cs_config_init_range(
+	    &tester->low, min_count, -hi, -lo, log_eps);
+	geometric_schedule(tester, (min_count > 0) ? min_count : 1);
+}
+
+void martingale_cs_geometric_tester_check(
+    struct martingale_cs_geometric_tester *tester)
+{
+	if (tester->status != MARTINGALE_CS_TESTER_UNDECIDED) {
+		tester->checkpoint = 0;
+		return;
+	}
+
+	if (tester->sum > tester->high_threshold) {
+		tester->status = MARTINGALE_CS_TESTER_HIGH;
+		/* `n` only grows: never check again. */
+		tester->checkpoint = 0;
+		return;
+	}
+
+	if (-tester->sum > tester->low_threshold) {
+		tester->status = MARTINGALE_CS_TESTER_LOW;
+		tester->checkpoint = 0;
+		return;
+	}
+
+	geometric_schedule(
+	    tester, next_checkpoint(tester->checkpoint, tester->ratio));
+}
+
+uint64_t martingale_cs_geometric_max_delay(double ratio, uint64_t n)
+{
+	/*
+	 * The previous checkpoint is at most `n - 1`, so the next one
+	 * is at most `max(n, ceil(ratio (n - 1)))`.
+	 */
+	const uint64_t next = (n > 1) ? next_checkpoint(n - 1, ratio) : n;
+
+	return (next > n) ? next - n : 0;
+}
@@ -0,0 +1,189 @@
+#ifndef MARTINGALE_CS_TESTER_H
+#define MARTINGALE_CS_TESTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "martingale-cs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Streaming sequential test for the null hypothesis that i.i.d.
+ * observations in `[lo, hi]` have zero mean, i.e., the loop that
+ * every caller otherwise writes by hand around
+ * `martingale_cs_threshold_range`: accumulate the sum, bump n, and
+ * compare against the threshold.
+ *
+ * The tester caches the earliest `n` at which the sum could cross a
+ * threshold (`martingale_cs_config_next_check`), so most calls to
+ * `martingale_cs_tester_push` are an add and a compare.  Once the
+ * test rejects the null, the decision sticks.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_tester {
+	double sum;
+	uint64_t n;
+	/* Call `martingale_cs_tester_check` once `n >= next_check`. */
+	uint64_t next_check;
+	int status;
+	int two_sided;
+	double lo;
+	double hi;
+	/* `high` tests `sum`, `low` tests `-sum` (if two-sided). */
+	struct martingale_cs_config high;
+	struct martingale_cs_config low;
+};
+
+/* The test hasn't rejected the null (yet). */
+#define MARTINGALE_CS_TESTER_UNDECIDED 0
+/* The mean is positive. */
+#define MARTINGALE_CS_TESTER_HIGH 1
+/* The mean is negative (two-sided tests only). */
+#define MARTINGALE_CS_TESTER_LOW -1
+
+/*
+ * Initialises `tester` for observations in `[lo, hi]`, with a total
+ * false positive rate of `exp(log_eps)`; see
+ * `martingale_cs_threshold_range` for `min_count` and `log_eps`.
+ *
+ * A one-sided tester only detects positive means (negate the
+ * observations and swap `-lo` and `-hi` for the other direction).  A
+ * two-sided tester detects both, and splits `log_eps` between the two
+ * tails, like adding `martingale_cs_eq`.
+ */
+void martingale_cs_tester_init(struct martingale_cs_tester *tester,
+    uint64_t min_count, double lo, double hi, double log_eps,
+    int two_sided);
+
+/*
+ * Compares the current sum against the thresholds, updates the
+ * status, and refreshes `next_check`.  `martingale_cs_tester_push`
+ * calls this when needed; there's no reason to call it directly.
+ */
+void martingale_cs_tester_check(struct martingale_cs_tester *tester);
+
+/*
+ * Adds an observation, and returns the tester's status.  Values
+ * outside `[lo, hi]` are clipped to the range.
+ */
+static inline int martingale_cs_tester_push(
+    struct martingale_cs_tester *tester, double x)
+{
+	x = (x < tester->lo) ? tester->lo : x;
+	x = (x > tester->hi) ? tester->hi : x;
+	tester->sum += x;
+	if (++tester->n >= tester->next_check) {
+		martingale_cs_tester_check(tester);
+	}
+
+	return tester->status;
+}
+
+/*
+ * Adds `count` observations, and returns the tester's status.
+ *
+ * Equivalent to calling `martingale_cs_tester_push` on each value, in
+ * order (the resulting sum is bit-identical), but only stops to check
+ * the thresholds at `next_check`.
+ */
+int martingale_cs_tester_push_many(
+    struct martingale_cs_tester *tester, const double *xs, size_t count);
+
+/*
+ * Returns `MARTINGALE_CS_TESTER_UNDECIDED`, or the direction in which
+ * the tester rejected the null hypothesis.
+ */
+static inline int martingale_cs_tester_status(
+    const struct martingale_cs_tester *tester)
+{
+	return tester->status;
+}
+
+/*
+ * Cheaper variant of the tester for monitoring, that only compares the
+ * sum against the thresholds at geometrically spaced checkpoints:
+ * `min_count`, then `max(c + 1, ceil(ratio c))` after checkpoint `c`.
+ *
+ * The confidence sequence holds at every n simultaneously, so
+ * checking at a subset of n is just as sound; it only takes
+ * `O(log(n) / log(ratio))` threshold evaluations over a run of n
+ * observations.  The tester precomputes the next checkpoint and its
+ * thresholds, so each push is an add, an increment, and an integer
+ * compare.
+ *
+ * The price is detection delay: a sum that first crosses the
+ * threshold at n, and stays above it, is only noticed at the next
+ * checkpoint, at most `martingale_cs_geometric_max_delay(ratio, n)`
+ * observations later, i.e., a relative delay of at most `ratio - 1`.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_geometric_tester {
+	double sum;
+	uint64_t n;
+	/* Call `martingale_cs_geometric_tester_check` at this n. */
+	uint64_t checkpoint;
+	/* The thresholds for `sum` and `-sum` at `checkpoint`. */
+	double high_threshold;
+	double low_threshold;
+	double ratio;
+	int status;
+	int two_sided;
+	double lo;
+	double hi;
+	struct martingale_cs_config high;
+	struct martingale_cs_config low;
+};
+
+/*
+ * Initialises `tester` like `martingale_cs_tester_init`, with
+ * checkpoints `ratio > 1` apart.
+ */
+void martingale_cs_geometric_tester_init(
+    struct martingale_cs_geometric_tester *tester, uint64_t min_count,
+    double lo, double hi, double log_eps, int two_sided, double ratio);
+
+/*
+ * Compares the sum against the checkpoint's thresholds, updates the
+ * status, and moves to the next checkpoint.
+ */
+void martingale_cs_geometric_tester_check(
+    struct martingale_cs_geometric_tester *tester);
+
+/*
+ * Adds an observation, clipped to `[lo, hi]`, and returns the tester's
+ * status (`MARTINGALE_CS_TESTER_*`).
+ */
+static inline int martingale_cs_geometric_tester_push(
+    struct martingale_cs_geometric_tester *tester, double x)
+{
+	x = (x < tester->lo) ? tester->lo : x;
+	x = (x > tester->hi) ? tester->hi : x;
+	tester->sum += x;
+	if (++tester->n == tester->checkpoint) {
+		martingale_cs_geometric_tester_check(tester);
+	}
+
+	return tester->status;
+}
+
+static inline int martingale_cs_geometric_tester_status(
+    const struct martingale_cs_geometric_tester *tester)
+{
+	return tester->status;
+}
+
+/*
+ * Returns the largest number of observations between `n > 0` and the
+ * first checkpoint at or after `n`, for checkpoints `ratio` apart.
+ */
+uint64_t martingale_cs_geometric_max_delay(double ratio, uint64_t n);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+#endif /* !MARTINGALE_CS_TESTER_H */
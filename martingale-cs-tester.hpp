@@ -0,0 +1,72 @@
+#ifndef MARTINGALE_CS_TESTER_HPP
+#define MARTINGALE_CS_TESTER_HPP
+/*
+ * C++ wrapper for `martingale_cs_tester`.
+ *
+ *   martingale_cs::tester test(32, -1, 1, std::log(1e-3));
+ *   for (...) {
+ *           if (test.push(x) != martingale_cs::tester::kUndecided)
+ *                   break;
+ *   }
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "martingale-cs-tester.h"
+
+namespace martingale_cs {
+class tester {
+    public:
+	enum decision {
+		kLow = MARTINGALE_CS_TESTER_LOW,
+		kUndecided = MARTINGALE_CS_TESTER_UNDECIDED,
+		kHigh = MARTINGALE_CS_TESTER_HIGH,
+	};
+
+	tester(uint64_t min_count, double lo, double hi, double log_eps,
+	    bool two_sided = true)
+	{
+		martingale_cs_tester_init(
+		    &tester_, min_count, lo, hi, log_eps, two_sided ? 1 : 0);
+	}
+
+	decision push(double x)
+	{
+		return static_cast<decision>(
+		    martingale_cs_tester_push(&tester_, x));
+	}
+
+	decision push_many(const double *xs, size_t count)
+	{
+		return static_cast<decision>(
+		    martingale_cs_tester_push_many(&tester_, xs, count));
+	}
+
+	/* Any contiguous container of doubles, e.g., std::vector. */
+	template <typename Container> decision push_many(const Container &xs)
+	{
+		return push_many(xs.data(), xs.size());
+	}
+
+	decision status() const
+	{
+		return static_cast<decision>(
+		    martingale_cs_tester_status(&tester_));
+	}
+
+	bool decided() const { return status() != kUndecided; }
+
+	/* Sum of the (clipped) observations so far. */
+	double sum() const { return tester_.sum; }
+
+	uint64_t count() const { return tester_.n; }
+
+	/* The next observation count at which the thresholds matter. */
+	uint64_t next_check() const { return tester_.next_check; }
+
+    private:
+	struct martingale_cs_tester tester_;
+};
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_TESTER_HPP */
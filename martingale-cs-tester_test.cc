@@ -0,0 +1,263 @@
+#include "martingale-cs-tester.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "martingale-cs-tester.hpp"
+
+namespace {
+// The loop that the tester replaces: check both thresholds after
+// every observation.  Returns the count and direction of the first
+// rejection, or (0, undecided).
+std::pair<uint64_t, int> NaiveDecision(const std::vector<double> &xs,
+    uint64_t min_count, double lo, double hi, double log_eps)
+{
+	struct martingale_cs_config high, low;
+	double sum = 0;
+
+	martingale_cs_config_init_range(
+	    &high, min_count, lo, hi, log_eps + martingale_cs_eq);
+	martingale_cs_config_init_range(
+	    &low, min_count, -hi, -lo, log_eps + martingale_cs_eq);
+	for (size_t i = 0; i < xs.size(); ++i) {
+		sum += xs[i];
+		if (martingale_cs_config_exceeds(&high, sum, i + 1)) {
+			return { i + 1, MARTINGALE_CS_TESTER_HIGH };
+		}
+
+		if (martingale_cs_config_exceeds(&low, -sum, i + 1)) {
+			return { i + 1, MARTINGALE_CS_TESTER_LOW };
+		}
+	}
+
+	return { 0, MARTINGALE_CS_TESTER_UNDECIDED };
+}
+
+// The cached next check must never delay a decision.
+TEST(MartingaleCsTester, MatchesNaiveLoop)
+{
+	std::mt19937_64 rng(1);
+
+	for (size_t iter = 0; iter < 200; ++iter) {
+		const double lo = -0.1 - (rng() % 100) / 50.0;
+		const double hi = 0.1 + (rng() % 100) / 50.0;
+		const double p_hi = -lo / (hi - lo)
+		    + ((rng() % 21) - 10.0) / 200.0;
+		std::bernoulli_distribution coin(p_hi);
+		std::vector<double> xs(20000);
+		struct martingale_cs_tester tester;
+
+		for (double &x : xs) {
+			x = coin(rng) ? hi : lo;
+		}
+
+		const auto expected = NaiveDecision(xs, 32, lo, hi, -5);
+		martingale_cs_tester_init(&tester, 32, lo, hi, -5, 1);
+		for (size_t i = 0; i < xs.size(); ++i) {
+			const int status
+			    = martingale_cs_tester_push(&tester, xs[i]);
+
+			if (i + 1 < expected.first || expected.first == 0) {
+				ASSERT_EQ(status,
+				    MARTINGALE_CS_TESTER_UNDECIDED)
+				    << iter << " " << i;
+			} else {
+				ASSERT_EQ(status, expected.second)
+				    << iter << " " << i;
+			}
+		}
+	}
+}
+
+TEST(MartingaleCsTester, PushManyMatchesPush)
+{
+	std::mt19937_64 rng(2);
+	std::uniform_real_distribution<double> dist(-1.5, 1.4);
+
+	for (size_t iter = 0; iter < 50; ++iter) {
+		std::vector<double> xs(1 + rng() % 50000);
+		struct martingale_cs_tester one, many;
+
+		for (double &x : xs) {
+			x = dist(rng);
+		}
+
+		martingale_cs_tester_init(&one, 10, -1, 1, -3, iter % 2);
+		martingale_cs_tester_init(&many, 10, -1, 1, -3, iter % 2);
+		for (double x : xs) {
+			martingale_cs_tester_push(&one, x);
+		}
+
+		size_t begin = 0;
+		while (begin < xs.size()) {
+			const size_t count = std::min<size_t>(
+			    rng() % 5000, xs.size() - begin);
+
+			martingale_cs_tester_push_many(
+			    &many, xs.data() + begin, count);
+			begin += count;
+		}
+
+		EXPECT_EQ(one.sum, many.sum);
+		EXPECT_EQ(one.n, many.n);
+		EXPECT_EQ(martingale_cs_tester_status(&one),
+		    martingale_cs_tester_status(&many));
+	}
+}
+
+TEST(MartingaleCsTester, ClipsAndSticks)
+{
+	struct martingale_cs_tester tester;
+
+	martingale_cs_tester_init(&tester, 2, -1, 1, -10, 0);
+	EXPECT_EQ(martingale_cs_tester_push(&tester, 100), 0);
+	EXPECT_EQ(tester.sum, 1);
+	EXPECT_EQ(martingale_cs_tester_push(&tester, -100), 0);
+	EXPECT_EQ(tester.sum, 0);
+
+	// A one-sided tester never rejects low.
+	for (size_t i = 0; i < 10000; ++i) {
+		ASSERT_EQ(martingale_cs_tester_push(&tester, -1),
+		    MARTINGALE_CS_TESTER_UNDECIDED);
+	}
+
+	// Cancel the negative sum, and drift up until we reject.
+	int status = MARTINGALE_CS_TESTER_UNDECIDED;
+	for (size_t i = 0; i < 100000 && status == 0; ++i) {
+		status = martingale_cs_tester_push(&tester, 1);
+	}
+
+	ASSERT_EQ(status, MARTINGALE_CS_TESTER_HIGH);
+	for (size_t i = 0; i < 100000; ++i) {
+		ASSERT_EQ(martingale_cs_tester_push(&tester, -1),
+		    MARTINGALE_CS_TESTER_HIGH);
+	}
+}
+
+// Under the null, most pushes shouldn't need a check.
+TEST(MartingaleCsTester, FewChecks)
+{
+	std::mt19937_64 rng(3);
+	std::bernoulli_distribution coin(0.5);
+	struct martingale_cs_tester tester;
+	size_t checks = 0;
+	uint64_t last_next = 0;
+
+	martingale_cs_tester_init(&tester, 32, -1, 1, -10, 1);
+	for (size_t i = 0; i < 1000000; ++i) {
+		martingale_cs_tester_push(&tester, coin(rng) ? 1 : -1);
+		checks += tester.next_check != last_next;
+		last_next = tester.next_check;
+	}
+
+	EXPECT_EQ(martingale_cs_tester_status(&tester),
+	    MARTINGALE_CS_TESTER_UNDECIDED);
+	EXPECT_LT(checks, 10000);
+}
+
+TEST(MartingaleCsTester, Wrapper)
+{
+	martingale_cs::tester tester(32, -1, 1, -5);
+	std::vector<double> xs(1000, -1);
+
+	EXPECT_EQ(tester.push(0.5), martingale_cs::tester::kUndecided);
+	EXPECT_EQ(tester.push_many(xs), martingale_cs::tester::kLow);
+	EXPECT_TRUE(tester.decided());
+	EXPECT_EQ(tester.count(), 1001);
+	EXPECT_EQ(tester.sum(), -999.5);
+	EXPECT_EQ(tester.next_check(), UINT64_MAX);
+}
+
+// Checking only at checkpoints is the same as the naive loop, with
+// the test skipped between checkpoints.
+TEST(MartingaleCsTester, GeometricMatchesCheckpoints)
+{
+	std::mt19937_64 rng(4);
+	size_t decided = 0;
+
+	for (size_t iter = 0; iter < 100; ++iter) {
+		const double ratio = 1.01 + (rng() % 100) / 100.0;
+		const double p_hi = 0.5 + ((rng() % 21) - 10.0) / 200.0;
+		const int two_sided = iter % 2;
+		std::bernoulli_distribution coin(p_hi);
+		struct martingale_cs_config high, low;
+		struct martingale_cs_geometric_tester tester;
+		const double log_eps
+		    = -5 + (two_sided ? martingale_cs_eq : 0);
+		uint64_t checkpoint = 32;
+		double sum = 0;
+		int expected = MARTINGALE_CS_TESTER_UNDECIDED;
+
+		martingale_cs_config_init_range(&high, 32, -1, 1, log_eps);
+		martingale_cs_config_init_range(&low, 32, -1, 1, log_eps);
+		martingale_cs_geometric_tester_init(
+		    &tester, 32, -1, 1, -5, two_sided, ratio);
+		for (uint64_t n = 1; n <= 20000; ++n) {
+			const double x = coin(rng) ? 1 : -1;
+
+			sum += x;
+			if (n == checkpoint && expected == 0) {
+				if (sum > martingale_cs_config_threshold(
+					&high, n)) {
+					expected = MARTINGALE_CS_TESTER_HIGH;
+				} else if (two_sided
+				    && -sum > martingale_cs_config_threshold(
+					   &low, n)) {
+					expected = MARTINGALE_CS_TESTER_LOW;
+				}
+
+				const uint64_t next
+				    = std::ceil(ratio * checkpoint);
+
+				checkpoint = std::max(checkpoint + 1, next);
+			}
+
+			ASSERT_EQ(martingale_cs_geometric_tester_push(
+				      &tester, x),
+			    expected)
+			    << iter << " " << n;
+		}
+
+		decided += expected != MARTINGALE_CS_TESTER_UNDECIDED;
+	}
+
+	// Make sure the test exercises decisions.
+	EXPECT_GT(decided, 20);
+}
+
+TEST(MartingaleCsTester, GeometricFewChecks)
+{
+	struct martingale_cs_geometric_tester tester;
+	size_t checks = 0;
+	uint64_t last = 0;
+
+	martingale_cs_geometric_tester_init(&tester, 32, -1, 1, -10, 1, 1.1);
+	for (size_t i = 0; i < 1000000; ++i) {
+		martingale_cs_geometric_tester_push(
+		    &tester, (i % 2) ? 1 : -1);
+		checks += tester.checkpoint != last;
+		last = tester.checkpoint;
+	}
+
+	// log(1e6 / 32) / log(1.1) ~ 108.
+	EXPECT_LT(checks, 120);
+	EXPECT_EQ(martingale_cs_geometric_tester_status(&tester),
+	    MARTINGALE_CS_TESTER_UNDECIDED);
+}
+
+TEST(MartingaleCsTester, GeometricMaxDelay)
+{
+	EXPECT_EQ(martingale_cs_geometric_max_delay(2, 1), 0);
+	EXPECT_EQ(martingale_cs_geometric_max_delay(2, 2), 0);
+	EXPECT_EQ(martingale_cs_geometric_max_delay(2, 1001), 1000 - 1);
+	EXPECT_EQ(martingale_cs_geometric_max_delay(1.1, 1001), 99);
+	EXPECT_EQ(martingale_cs_geometric_max_delay(1.01, 100), 0);
+	// Saturates at UINT64_MAX.
+	EXPECT_EQ(martingale_cs_geometric_max_delay(3, UINT64_MAX / 2),
+	    UINT64_MAX - UINT64_MAX / 2);
+}
+} // namespace
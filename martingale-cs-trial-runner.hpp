@@ -0,0 +1,138 @@
+#ifndef MARTINGALE_CS_TRIAL_RUNNER_HPP
+#define MARTINGALE_CS_TRIAL_RUNNER_HPP
+/*
+ * Parallel runner for independent Monte Carlo trials, for the
+ * statistical test suites.
+ *
+ *   run_trials(max_trials,
+ *       [] { return workspace(); },
+ *       [](size_t index, workspace &ws) { return trial(index, ws); },
+ *       [](size_t index, bool success) { return done; });
+ *
+ * Worker threads claim trial indices from a shared counter, so a slow
+ * trial never holds back the others, and each thread reuses its own
+ * workspace (e.g., observation buffers) for all its trials.  The
+ * calling thread consumes the results strictly in index order, and
+ * stops everything as soon as `consume` returns true.  Workers never
+ * claim a trial `kTrialLookahead * num_threads` or more past the last
+ * consumed one, so at most that many trials run for nothing after
+ * `consume` stops, however slow the calling thread.
+ *
+ * As long as each trial only depends on its index (e.g., seeds its
+ * RNG from the index), the sequence of results that `consume` sees,
+ * and thus any sequential stopping rule, is the same as for a
+ * sequential loop, whatever the number of threads.
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace martingale_cs {
+
+/* How many trials per thread the workers may run ahead of `consume`. */
+constexpr size_t kTrialLookahead = 4;
+
+/*
+ * Runs `trial(index, workspace)` for `index` in `[0, max_trials)` on
+ * `num_threads` threads (0 for one per core), where each thread gets
+ * its own `make_workspace()`.  Calls `consume(index, result)` on the
+ * calling thread for each result in order, until `consume` returns
+ * true.  Returns the number of results consumed.
+ */
+template <typename MakeWorkspace, typename Trial, typename Consume>
+size_t run_trials(size_t max_trials, MakeWorkspace make_workspace,
+    Trial trial, Consume consume, size_t num_threads = 0)
+{
+	enum : uint8_t { kPending, kFailure, kSuccess };
+
+	std::vector<uint8_t> results(max_trials, kPending);
+	/* `mutex` protects `results`, `next_trial`, `consumed` and `stop`. */
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable room;
+	size_t next_trial = 0;
+	size_t consumed = 0;
+	bool stop = false;
+
+	if (num_threads == 0) {
+		num_threads = std::thread::hardware_concurrency();
+		num_threads = std::max<size_t>(num_threads, 1);
+	}
+
+	const size_t window = kTrialLookahead * num_threads;
+	auto work = [&] {
+		auto workspace = make_workspace();
+
+		for (;;) {
+			size_t index;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				room.wait(lock, [&] {
+					return stop
+					    || next_trial < consumed + window;
+				});
+				if (stop || next_trial >= max_trials) {
+					break;
+				}
+
+				index = next_trial++;
+			}
+
+			const uint8_t result
+			    = trial(index, workspace) ? kSuccess : kFailure;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				results[index] = result;
+			}
+
+			ready.notify_one();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < std::min(num_threads, max_trials); ++i) {
+		workers.emplace_back(work);
+	}
+
+	for (;;) {
+		size_t index;
+		uint8_t result;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (consumed >= max_trials) {
+				break;
+			}
+
+			ready.wait(lock,
+			    [&] { return results[consumed] != kPending; });
+			index = consumed++;
+			result = results[index];
+		}
+
+		room.notify_all();
+		if (consume(index, result == kSuccess)) {
+			break;
+		}
+	}
+
+	/* Trials in flight finish; nobody claims new ones. */
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+
+	room.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+
+	return consumed;
+}
+
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_TRIAL_RUNNER_HPP */
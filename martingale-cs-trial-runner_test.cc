@@ -0,0 +1,99 @@
+#include "martingale-cs-trial-runner.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+// A trial whose result and running time depend only on its index.
+bool Trial(size_t index, std::vector<uint64_t> &buffer)
+{
+	std::mt19937_64 rng(index);
+
+	buffer.resize(1 + rng() % 10000);
+	for (uint64_t &x : buffer) {
+		x = rng();
+	}
+
+	return (buffer.back() % 3) != 0;
+}
+
+std::vector<bool> Results(size_t num_threads, size_t max_trials)
+{
+	std::vector<bool> results;
+
+	martingale_cs::run_trials(
+	    max_trials, [] { return std::vector<uint64_t>(); }, Trial,
+	    [&](size_t index, bool success) {
+		    EXPECT_EQ(index, results.size());
+		    results.push_back(success);
+		    return false;
+	    },
+	    num_threads);
+	return results;
+}
+
+TEST(MartingaleCsTrialRunner, SameResultsForAnyThreadCount)
+{
+	const std::vector<bool> expected = Results(1, 500);
+
+	ASSERT_EQ(expected.size(), 500);
+	for (size_t num_threads : { 2, 3, 8, 0 }) {
+		EXPECT_EQ(Results(num_threads, 500), expected) << num_threads;
+	}
+}
+
+TEST(MartingaleCsTrialRunner, StopsEarly)
+{
+	std::atomic<size_t> trials(0);
+	std::atomic<size_t> workspaces(0);
+
+	const size_t consumed = martingale_cs::run_trials(
+	    100000,
+	    [&] {
+		    workspaces++;
+		    return std::vector<uint64_t>();
+	    },
+	    [&](size_t index, std::vector<uint64_t> &buffer) {
+		    trials++;
+		    return Trial(index, buffer);
+	    },
+	    [](size_t index, bool) { return index == 37; }, 4);
+
+	EXPECT_EQ(consumed, 38);
+	EXPECT_LE(workspaces.load(), 4);
+	// Workers can't run far ahead of the consumer.
+	EXPECT_LE(trials.load(), 38 + martingale_cs::kTrialLookahead * 4);
+}
+
+// Same bound when the consumer is much slower than the trials.
+TEST(MartingaleCsTrialRunner, SlowConsumer)
+{
+	std::atomic<size_t> trials(0);
+
+	martingale_cs::run_trials(
+	    100000, [] { return 0; },
+	    [&](size_t, int) {
+		    trials++;
+		    return true;
+	    },
+	    [&](size_t index, bool) {
+		    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		    EXPECT_LE(trials.load(),
+			index + 1 + martingale_cs::kTrialLookahead * 4);
+		    return index == 20;
+	    },
+	    4);
+	EXPECT_LE(trials.load(), 21 + martingale_cs::kTrialLookahead * 4);
+}
+
+TEST(MartingaleCsTrialRunner, NoTrials)
+{
+	EXPECT_EQ(Results(4, 0).size(), 0);
+}
+} // namespace
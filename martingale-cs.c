@@ -14,6 +14,12 @@ const double martingale_cs_eq = -0.6931471805599454;
 /* -1/2 log log 2, rounded up. */
 static const double minus_half_log_log_2_up = 0.1832564602908322;
 
+/*
+ * log log 2^64 = 3.79233..., rounded up far enough to also bound
+ * `log_up(log_up(n))` for any 64-bit n.
+ */
+static const double log_log_max_up = 3.7924;
+
 /*
  * Safe-rounding utilities.  Not because it makes a difference, but
  * because extreme p-values means we should be extra confidence.
@@ -59,17 +65,126 @@ static inline double prev_k(double x, uint64_t delta)
 
 static inline double prev(double x) { return prev_k(x, 1); }
 
-/* Assume libm is off by < 4 ULPs. */
-static const uint64_t libm_error_limit = 4;
+/*
+ * High and low parts of log(2), as in fdlibm: ln2_hi is a multiple
+ * of 2^-32, with 21 significant bits, so k * ln2_hi is exact for any
+ * exponent k.
+ */
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+
+/* 1 / log(2), rounded to nearest. */
+static const double log2_e = 1.4426950408889634;
+
+/*
+ * Table for `log_approx`.  Entry i covers the values z in [0.6875,
+ * 1.375) with (bits(z) - bits(0.6875)) >> 45 = i, i.e., intervals of
+ * width 2^-8 below 1, and 2^-7 above.  `c` is the (dyadic, exact)
+ * midpoint of the interval, except for the two intervals adjacent
+ * to 1, where c = 1.  `inv_c` is 1 / c rounded to nearest, and
+ * `log_c_hi + log_c_lo` is log(c), with `log_c_hi` rounded to a
+ * multiple of 2^-32 so that `k ln2_hi + log_c_hi` is exact.
+ *
+ * Generated with Python's decimal module, at 60 digits of precision.
+ * The rows live in martingale-cs-log-table.inc, to share them with
+ * the constexpr code in martingale-cs.hpp.
+ */
+static const struct log_table_entry {
+	double c;
+	double inv_c;
+	double log_c_hi;
+	double log_c_lo;
+} log_table[128] = {
+#include "martingale-cs-log-table.inc"
+};
+
+/* bits(0.6875).  Centers [0.6875, 1.375) around 1. */
+static const uint64_t log_table_offset = 0x3FE6000000000000ULL;
+
+/*
+ * Returns log(x) for a positive normal `x`, within 3 ULPs.
+ *
+ * We split x = 2^k z, with z in [0.6875, 1.375), and find the table
+ * entry for z.  Then log(x) = k log(2) + log(c) + log1p(r), with r =
+ * (z - c) / c, and |r| < 2^-7.
+ *
+ * Let u = 2^-53.  z - c is exact (Sterbenz), so r is off by at most
+ * 2u |r| (exact when c = 1).  w = k ln2_hi + log_c_hi is exact.  When
+ * w != 0, |w| >= 0.0058 > 2|r|, so |log x| >= |r| and w + r is an
+ * exact Fast2Sum `hi + lo`.  The degree-8 Taylor series for log1p(r)
+ * - r truncates less than 2^-59 |r|, and r^2 q is less than 2^-8 |r|,
+ * so its rounding errors are negligible, as are those of the tiny
+ * `lo` terms.  The total error is thus at most u |r| <= u |log x| for
+ * r, plus u |log x| for the final addition, and a bit of slop: less
+ * than 3 ULPs.
+ */
+static inline double log_approx(double x)
+{
+	uint64_t bits;
+	double z;
+
+	memcpy(&bits, &x, sizeof(bits));
+	const uint64_t tmp = bits - log_table_offset;
+	const struct log_table_entry *entry = &log_table[(tmp >> 45) % 128];
+	/* The arithmetic shift keeps k's sign. */
+	const double k = (double)((int64_t)tmp >> 52);
+	bits -= tmp & (0xFFFULL << 52);
+	memcpy(&z, &bits, sizeof(z));
+
+	const double r = (z - entry->c) * entry->inv_c;
+	const double w = k * ln2_hi + entry->log_c_hi;
+	const double hi = w + r;
+	const double lo = (w - hi) + r;
+	/* log1p(r) - r = r^2 q, evaluated with Estrin's scheme. */
+	const double r2 = r * r;
+	const double q = ((-1.0 / 2 + r * (1.0 / 3))
+			     + r2 * (-1.0 / 4 + r * (1.0 / 5)))
+	    + (r2 * r2) * ((-1.0 / 6 + r * (1.0 / 7)) + r2 * (-1.0 / 8));
+
+	return hi + ((lo + (k * ln2_lo + entry->log_c_lo)) + r2 * q);
+}
+
+/* log_approx is off by < 3 ULPs; round up to 4. */
+static const uint64_t log_error_limit = 4;
 
 static inline double log_up(double x)
 {
-	return next_k(log(x), libm_error_limit);
+	return next_k(log_approx(x), log_error_limit);
 }
 
+/*
+ * Multiplying by log2_e adds two more roundings, both less than
+ * 1 ULP.
+ */
 static inline double log2_down(double x)
 {
-	return prev_k(log2(x), libm_error_limit);
+	return prev_k(log_approx(x) * log2_e, log_error_limit + 2);
+}
+
+/*
+ * log log n, rounded up, for `n >= 2`.  We assume the conversion of
+ * `n` to double is exact.  If it isn't, the values are so large that
+ * the relative error is much less than an ULP of log n.
+ */
+static inline double log_log_up(uint64_t n) { return log_up(log_up(n)); }
+
+double martingale_cs_log_up(double x) { return log_up(x); }
+
+double martingale_cs_log2_down(double x) { return log2_down(x); }
+
+/*
+ * Returns an upper bound for `log_log_up(n)`, for all `2 <= n <= hi`.
+ *
+ * `log_approx` might not be monotonic, but it's off by less than
+ * `log_error_limit` ULPs, so `log_up(n) <= log(n) + 2 * limit <=
+ * log(hi) + 2 * limit <= log_up(hi) + 2 * limit` (in ULPs).  Apply
+ * the same reasoning to the outer `log_up`.
+ */
+static inline double log_log_bound_up(uint64_t hi)
+{
+	const uint64_t slack = 2 * log_error_limit;
+
+	return next_k(log_up(next_k(log_up(hi), slack)), slack);
 }
 
 static inline double sqrt_up(double x)
@@ -142,7 +257,18 @@ static const double log_a_up(uint64_t min_count, double log_eps)
 	return log_up(next(1.0 / inv_q_m)) - log_eps;
 }
 
-double martingale_cs_threshold(uint64_t n, uint64_t min_count, double log_eps)
+/* Values for `martingale_cs_config.flags`. */
+enum {
+	/* Rescale the threshold by `scale`, like the `_span` variant. */
+	CONFIG_SCALED = 1,
+	/* `log_eps >= 0`: always reject once `n >= min_count`. */
+	CONFIG_ALWAYS_REJECT = 2,
+	/* Degenerate `_range`: the threshold is always 0. */
+	CONFIG_ZERO = 4,
+};
+
+static void config_init(struct martingale_cs_config *config,
+    uint64_t min_count, double log_eps)
 {
 	assert(log_eps <= 0 && "Positive log_eps means > 100% false positive "
 			       "rate. Should it be negated?");
@@ -151,17 +277,28 @@ double martingale_cs_threshold(uint64_t n, uint64_t min_count, double log_eps)
 		min_count = c;
 	}
 
-	if (n < min_count) {
-		return HUGE_VAL;
-	}
+	config->min_count = min_count;
+	config->quarter_log_a = 0;
+	config->scale = 1;
+	config->flags = 0;
 
 	if (log_eps >= 0) {
 		/* >= 100% false positive rate: just always reject. */
-		return -HUGE_VAL;
+		config->flags |= CONFIG_ALWAYS_REJECT;
+		return;
 	}
 
-	const double log_a = log_a_up(min_count, log_eps);
+	/* Multiplication by 0.25 is exact. */
+	config->quarter_log_a = 0.25 * log_a_up(min_count, log_eps);
+}
 
+/*
+ * Computes the unscaled threshold for `n >= config->min_count`
+ * observations, given an upper bound on `log log n`.
+ */
+static double threshold_log_log(
+    const struct martingale_cs_config *config, uint64_t n, double log_log_n)
+{
 	/*
 	 * n f_n(A)
 	 *   = sqrt(n) (3 / 2sqrt(2)) sqrt(4 log log n - 4 log log2 + 2 log A)
@@ -170,11 +307,78 @@ double martingale_cs_threshold(uint64_t n, uint64_t min_count, double log_eps)
 	 */
 
 	const double inner
-	    = next(next(.5 * log_up(log_up(n)) + minus_half_log_log_2_up)
-		+ 0.25 * log_a);
+	    = next(next(.5 * log_log_n + minus_half_log_log_2_up)
+		+ config->quarter_log_a);
 	return next(3 * sqrt_up(next(n * inner)));
 }
 
+/*
+ * Computes the unscaled threshold (`martingale_cs_threshold`) for
+ * `config`.
+ */
+static double unit_threshold(
+    const struct martingale_cs_config *config, uint64_t n)
+{
+	if (n < config->min_count) {
+		return HUGE_VAL;
+	}
+
+	if ((config->flags & CONFIG_ALWAYS_REJECT) != 0) {
+		return -HUGE_VAL;
+	}
+
+	return threshold_log_log(config, n, log_log_up(n));
+}
+
+/*
+ * Rescales `threshold` by `scale`, rounding up.  Infinite thresholds
+ * stay infinite: `next(HUGE_VAL)` would otherwise be a NaN.
+ */
+static double scale_threshold(double scale, double threshold)
+{
+	if (threshold == HUGE_VAL) {
+		return HUGE_VAL;
+	}
+
+	return next(scale * threshold);
+}
+
+void martingale_cs_config_init(
+    struct martingale_cs_config *config, uint64_t min_count, double log_eps)
+{
+	config_init(config, min_count, log_eps);
+}
+
+double martingale_cs_config_threshold(
+    const struct martingale_cs_config *config, uint64_t n)
+{
+	if ((config->flags & CONFIG_ZERO) != 0) {
+		return 0;
+	}
+
+	const double threshold = unit_threshold(config, n);
+	if ((config->flags & CONFIG_SCALED) == 0) {
+		return threshold;
+	}
+
+	return scale_threshold(config->scale, threshold);
+}
+
+double martingale_cs_threshold(uint64_t n, uint64_t min_count, double log_eps)
+{
+	struct martingale_cs_config config;
+
+	assert(log_eps <= 0 && "Positive log_eps means > 100% false positive "
+			       "rate. Should it be negated?");
+
+	if (n < min_count) {
+		return HUGE_VAL;
+	}
+
+	config_init(&config, min_count, log_eps);
+	return unit_threshold(&config, n);
+}
+
 /*
  * Hoeffding's lemma guarantees that any zero-mean distribution with a
  * range of span 2 satisfies our constraint that `mgf <= exp(t^2 /
@@ -183,11 +387,20 @@ double martingale_cs_threshold(uint64_t n, uint64_t min_count, double log_eps)
  * Rescale the width returned by `martingale_cs_threshold` as if the
  * `width = 2`.
  */
+void martingale_cs_config_init_span(struct martingale_cs_config *config,
+    uint64_t min_count, double span, double log_eps)
+{
+	config_init(config, min_count, log_eps);
+	config->scale = span / 2; /* Division by 2 is exact. */
+	config->flags |= CONFIG_SCALED;
+}
+
 double martingale_cs_threshold_span(
     uint64_t n, uint64_t min_count, double span, double log_eps)
 {
 	const double scale = span / 2; /* Division by 2 is exact. */
-	return next(scale * martingale_cs_threshold(n, min_count, log_eps));
+	return scale_threshold(
+	    scale, martingale_cs_threshold(n, min_count, log_eps));
 }
 
 /*
@@ -213,7 +426,46 @@ double martingale_cs_threshold_span(
  * and thus only need
  *   hi - lo <= 1/sqrt[p_hi (1 - p_hi)]
  * to guarantee mgf(\lambda) <= exp(1/2 \lambda^2).
+ *
+ * Returns the factor by which to scale `martingale_cs_threshold` for
+ * a zero-mean distribution with range `[lo, hi]`, `lo < 0 < hi`.
  */
+static double range_scale(double lo, double hi)
+{
+	const double span = next(hi - lo);
+	// We know the mean is zero, so `p_hi` is the max probability
+	// of observing `hi`.
+	const double p_hi = prev(-lo / span);
+
+	if (p_hi <= 0.5) {
+		return span / 2;
+	}
+
+	/*
+	 * Ideal span is 1 / sqrt[p_hi (1 - p_hi)], so we must scale
+	 * `span` by `span / ideal_span = sqrt[p_hi (1 - p_hi)] *
+	 * span`
+	 */
+	return next(sqrt_up(p_hi * next(1 - p_hi)) * span);
+}
+
+void martingale_cs_config_init_range(struct martingale_cs_config *config,
+    uint64_t min_count, double lo, double hi, double log_eps)
+{
+	config_init(config, min_count, log_eps);
+	config->flags |= CONFIG_SCALED;
+	/*
+	 * With this kind of range, the random values must all be exactly 0
+	 * to achieve a mean of zero.
+	 */
+	if (lo >= 0 || hi <= 0) {
+		config->flags |= CONFIG_ZERO;
+		return;
+	}
+
+	config->scale = range_scale(lo, hi);
+}
+
 double martingale_cs_threshold_range(
     uint64_t n, uint64_t min_count, double lo, double hi, double log_eps)
 {
@@ -225,23 +477,804 @@ double martingale_cs_threshold_range(
 		return 0;
 	}
 
-	const double span = next(hi - lo);
-	// We know the mean is zero, so `p_hi` is the max probability
-	// of observing `hi`.
-	const double p_hi = prev(-lo / span);
-	double scale;
-	if (p_hi <= 0.5) {
-		scale = span / 2;
-	} else {
+	return scale_threshold(range_scale(lo, hi),
+	    martingale_cs_threshold(n, min_count, log_eps));
+}
+
+uint64_t martingale_cs_config_next_check(
+    const struct martingale_cs_config *config, uint64_t n, double sum,
+    double max_step)
+{
+	/*
+	 * The thresholds are monotonic in n, except for the rounding
+	 * error in log log n.  Shave a few ULPs off each threshold to
+	 * get a lower bound for all later thresholds.
+	 */
+	static const uint64_t monotonicity_slack = 64;
+	uint64_t m = n + 1;
+
+	if (n == UINT64_MAX) {
+		return UINT64_MAX;
+	}
+
+	if ((config->flags & CONFIG_ZERO) == 0 && m < config->min_count) {
+		m = config->min_count;
+	}
+
+	for (;;) {
+		const double threshold
+		    = martingale_cs_config_threshold(config, m);
+		/* Over-approximate the sum at m. */
+		const double max_sum = next(
+		    sum + next_k((double)(m - n) * fmax(max_step, 0), 2));
+
+		if (max_sum > threshold) {
+			return m;
+		}
+
+		if (max_step <= 0) {
+			/*
+			 * The sum can't increase, and the threshold
+			 * can't decrease.
+			 */
+			return UINT64_MAX;
+		}
+
+		/*
+		 * We know the threshold is at least `threshold` for
+		 * all n' >= m.  The sum can't exceed that until `sum +
+		 * (n' - n) max_step > threshold`.  Round the number
+		 * of steps down.
+		 */
+		const double lower = prev_k(threshold, monotonicity_slack);
+		const double steps = floor(prev((lower - sum) / max_step));
+
+		if (!(steps < (double)(UINT64_MAX - n))) {
+			return UINT64_MAX;
+		}
+
+		uint64_t next_m = n + (uint64_t)fmax(steps, 0) + 1;
+		m = (next_m > m) ? next_m : m + 1;
+	}
+}
+
+uint64_t martingale_cs_next_check(uint64_t n, double sum, double span,
+    uint64_t min_count, double log_eps)
+{
+	struct martingale_cs_config config;
+
+	martingale_cs_config_init_span(&config, min_count, span, log_eps);
+	return martingale_cs_config_next_check(&config, n, sum, span);
+}
+
+/*
+ * Decision procedures for `sum > threshold`.
+ *
+ * The threshold is `3 sqrt(X)` (times `scale`), with `X = n inner`:
+ * compare `sum^2` against `9 X scale^2` instead.  The square root and
+ * the multiplications by 3 and `scale` each round up, so
+ * `threshold^2` can exceed `9 X scale^2` by (much) less than 32 ULPs;
+ * pad the squared bound by that much, and round `sum^2` down, to
+ * never return true unless `sum > threshold`.
+ */
+static const uint64_t squared_slack = 32;
+
+/*
+ * Returns 0 or 1 if bounds on `inner` suffice to decide whether `sum
+ * > threshold`, and -1 otherwise.  `sum`, `scale` and `inner_lo`
+ * must be positive.
+ */
+static inline int exceeds_inner_bounds(double sum, double n, double scale,
+    double inner_lo, double inner_hi)
+{
+	const double sum2 = sum * sum;
+	const double scale2 = scale * scale;
+	/* threshold >= 3 scale sqrt(n inner_lo). */
+	const double lo = prev_k(9 * (n * inner_lo) * scale2, squared_slack);
+	const double hi
+	    = next_k(9 * next(n * inner_hi) * scale2, squared_slack);
+
+	if (next(sum2) <= lo) {
+		return 0;
+	}
+
+	if (prev(sum2) > hi) {
+		return 1;
+	}
+
+	return -1;
+}
+
+/*
+ * Returns whether `sum > next(scale * threshold)` (or `sum >
+ * threshold` if `!scaled`), possibly without calling `log`.
+ */
+static int config_exceeds(const struct martingale_cs_config *config,
+    double sum, uint64_t n)
+{
+	const double scale
+	    = ((config->flags & CONFIG_SCALED) != 0) ? config->scale : 1;
+	const double q = config->quarter_log_a;
+
+	if ((config->flags & CONFIG_ZERO) != 0) {
+		return sum > 0;
+	}
+
+	if (n < config->min_count) {
+		return 0;
+	}
+
+	/*
+	 * Fall back to the threshold for the weird cases: always
+	 * reject, non-positive scale, or log(A) < 0 (eps close to 1).
+	 */
+	if ((config->flags & CONFIG_ALWAYS_REJECT) != 0 || !(scale > 0)
+	    || !(q > 0)) {
+		return sum > martingale_cs_config_threshold(config, n);
+	}
+
+	if (!(sum > 0)) {
+		return 0;
+	}
+
+	/*
+	 * inner = next(next(1/2 log log n - 1/2 log log 2) + log(A)/4)
+	 * >= log(A)/4, since log log n >= log log 2.
+	 */
+	const double n_double = n;
+	const double inner_hi
+	    = next(next(.5 * log_log_max_up + minus_half_log_log_2_up) + q);
+	const int prefilter
+	    = exceeds_inner_bounds(sum, n_double, scale, q, inner_hi);
+	if (prefilter >= 0) {
+		return prefilter;
+	}
+
+	const double log_log_n = log_log_up(n);
+	const double inner
+	    = next(next(.5 * log_log_n + minus_half_log_log_2_up) + q);
+	return prev(sum * sum)
+	    > next_k(9 * next(n_double * inner) * (scale * scale),
+		squared_slack);
+}
+
+/*
+ * Pre-filter for the config-less `exceeds` functions: bounds log(A)
+ * without calling `log`, and returns 0 or 1 if that's enough to
+ * decide, -1 otherwise.
+ */
+static int exceeds_prefilter(double sum, uint64_t n, uint64_t min_count,
+    double scale, double log_eps)
+{
+	if (min_count < c) {
+		min_count = c;
+	}
+
+	if (n < min_count) {
+		return 0;
+	}
+
+	if (log_eps >= 0 || !(scale > 0)) {
+		return -1;
+	}
+
+	if (!(sum > 0)) {
+		return 0;
+	}
+
+	/*
+	 * log(A) = log(1 / y) - log_eps, with y = lg m - 1/2 (rounded
+	 * down), and floor(lg m) <= lg m < floor(lg m) + 1.  Bound
+	 * log(1 / y) with 1 - y <= log(1 / y) <= 1 / y - 1, and pad
+	 * generously for rounding.
+	 */
+	const double floor_lg = 63 - __builtin_clzll(min_count);
+	const double log_a_lo
+	    = prev_k((1 - (floor_lg + 0.5) - 0.01) - log_eps, 4);
+	const double log_a_hi
+	    = next_k((1 / (floor_lg - 0.51) - 1 + 0.01) - log_eps, 4);
+
+	if (!(log_a_lo > 0)) {
+		return -1;
+	}
+
+	const double inner_hi = next(
+	    next(.5 * log_log_max_up + minus_half_log_log_2_up)
+	    + 0.25 * log_a_hi);
+	return exceeds_inner_bounds(
+	    sum, (double)n, scale, 0.25 * log_a_lo, inner_hi);
+}
+
+int martingale_cs_config_exceeds(
+    const struct martingale_cs_config *config, double sum, uint64_t n)
+{
+	return config_exceeds(config, sum, n);
+}
+
+int martingale_cs_exceeds(
+    double sum, uint64_t n, uint64_t min_count, double log_eps)
+{
+	struct martingale_cs_config config;
+	const int prefilter
+	    = exceeds_prefilter(sum, n, min_count, 1, log_eps);
+
+	if (prefilter >= 0) {
+		return prefilter;
+	}
+
+	martingale_cs_config_init(&config, min_count, log_eps);
+	return config_exceeds(&config, sum, n);
+}
+
+int martingale_cs_exceeds_span(double sum, uint64_t n, uint64_t min_count,
+    double span, double log_eps)
+{
+	struct martingale_cs_config config;
+	const int prefilter
+	    = exceeds_prefilter(sum, n, min_count, span / 2, log_eps);
+
+	if (prefilter >= 0) {
+		return prefilter;
+	}
+
+	martingale_cs_config_init_span(&config, min_count, span, log_eps);
+	return config_exceeds(&config, sum, n);
+}
+
+int martingale_cs_exceeds_range(double sum, uint64_t n, uint64_t min_count,
+    double lo, double hi, double log_eps)
+{
+	struct martingale_cs_config config;
+
+	if (lo >= 0 || hi <= 0) {
+		return sum > 0;
+	}
+
+	const int prefilter = exceeds_prefilter(
+	    sum, n, min_count, range_scale(lo, hi), log_eps);
+	if (prefilter >= 0) {
+		return prefilter;
+	}
+
+	martingale_cs_config_init_range(&config, min_count, lo, hi, log_eps);
+	return config_exceeds(&config, sum, n);
+}
+
+void martingale_cs_stepper_init(struct martingale_cs_stepper *stepper,
+    const struct martingale_cs_config *config, uint64_t n)
+{
+	stepper->config = *config;
+	stepper->n = n;
+	/* Force a refresh on the first call to advance. */
+	stepper->bracket_end = 0;
+	stepper->log_log_bound = HUGE_VAL;
+}
+
+double martingale_cs_stepper_advance(struct martingale_cs_stepper *stepper)
+{
+	const struct martingale_cs_config *config = &stepper->config;
+	const uint64_t n = ++stepper->n;
+
+	if (n < config->min_count
+	    || (config->flags & (CONFIG_ALWAYS_REJECT | CONFIG_ZERO)) != 0) {
+		return martingale_cs_config_threshold(config, n);
+	}
+
+	if (n > stepper->bracket_end) {
+		/*
+		 * log log n grows so slowly that a bracket of n / 16
+		 * only loosens the threshold by a fraction of a
+		 * percent, and we refresh O(log n) times in total.
+		 */
+		uint64_t end = n + (n >> 4);
+
+		if (end < n) {
+			end = UINT64_MAX;
+		}
+
+		stepper->bracket_end = end;
+		stepper->log_log_bound = log_log_bound_up(end);
+	}
+
+	const double threshold
+	    = threshold_log_log(config, n, stepper->log_log_bound);
+	if ((config->flags & CONFIG_SCALED) == 0) {
+		return threshold;
+	}
+
+	return scale_threshold(config->scale, threshold);
+}
+
+/*
+ * Returns an upper bound on `martingale_cs_config_threshold(config,
+ * n)` for all `n` in `[lo, hi]`.
+ *
+ * The unscaled threshold is monotonic in `n` and in the bound on log
+ * log n (every step rounds monotonically), so evaluating it at `hi`
+ * with `log_log_bound_up(hi)` covers the whole range.
+ */
+static double config_threshold_bound(
+    const struct martingale_cs_config *config, uint64_t lo, uint64_t hi)
+{
+	if ((config->flags & CONFIG_ZERO) != 0) {
+		return 0;
+	}
+
+	if (lo < config->min_count) {
+		return HUGE_VAL;
+	}
+
+	if ((config->flags & CONFIG_ALWAYS_REJECT) != 0) {
+		return -HUGE_VAL;
+	}
+
+	const double threshold
+	    = threshold_log_log(config, hi, log_log_bound_up(hi));
+	if ((config->flags & CONFIG_SCALED) == 0) {
+		return threshold;
+	}
+
+	return scale_threshold(config->scale, threshold);
+}
+
+/* Returns `threshold / unit`, rounded up to an integer and saturated. */
+static int64_t int_bound(double threshold, double unit)
+{
+	if (threshold == HUGE_VAL) {
+		return INT64_MAX;
+	}
+
+	if (threshold == -HUGE_VAL) {
+		return INT64_MIN;
+	}
+
+	/* ceil is exact, so we only have to round the division up. */
+	const double scaled = ceil(next(threshold / unit));
+	if (scaled >= 0x1p63) {
+		return INT64_MAX;
+	}
+
+	if (scaled < -0x1p63) {
+		return INT64_MIN;
+	}
+
+	return (int64_t)scaled;
+}
+
+void martingale_cs_int_table_init(struct martingale_cs_int_table *table,
+    const struct martingale_cs_config *config, double unit)
+{
+	const unsigned sub_bits = MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS;
+
+	assert(unit > 0 && "Integer sums need a positive unit.");
+
+	for (size_t i = 0; i < MARTINGALE_CS_INT_TABLE_SIZE; i++) {
+		uint64_t lo = i;
+		uint64_t hi = i;
+
 		/*
-		 * Ideal span is 1 / sqrt[p_hi (1 - p_hi)], so we must scale
-		 * `span` by `span / ideal_span = sqrt[p_hi (1 - p_hi)] *
-		 * span`
+		 * Invert `martingale_cs_int_table_index`: past the
+		 * first 2^(sub_bits + 1) singleton buckets, bucket i
+		 * covers the 2^shift values with `n >> shift = i -
+		 * (shift << sub_bits)`.
 		 */
-		scale = next(sqrt_up(p_hi * next(1 - p_hi)) * span);
+		if (i >= ((size_t)2 << sub_bits)) {
+			const unsigned shift = (unsigned)(i >> sub_bits) - 1;
+			const size_t top = i - ((size_t)shift << sub_bits);
+
+			lo = (uint64_t)top << shift;
+			hi = lo + ((UINT64_C(1) << shift) - 1);
+		}
+
+		table->bound[i]
+		    = int_bound(config_threshold_bound(config, lo, hi), unit);
+	}
+}
+
+/*
+ * Batch evaluation.
+ *
+ * The vector kernels follow the scalar code step by step, including
+ * the series in `log_approx`.  However, the compiler may contract
+ * some multiplications and additions in the vector `log` into FMAs,
+ * so we pad its result by much more than its error (a few ULPs): each
+ * vector `log_up` is at least as large as the scalar `log_up`, and
+ * every other step rounds up monotonically, so the vector thresholds
+ * are never less conservative than the scalar ones.
+ */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MARTINGALE_CS_X86_BATCH 1
+#include <immintrin.h>
+#else
+#define MARTINGALE_CS_X86_BATCH 0
+#endif
+
+#if MARTINGALE_CS_X86_BATCH
+/*
+ * The vector `log`s are off by at most a few ULPs; adding 2^-40 |x|
+ * more than covers that, and the `log_error_limit` ULPs of slack in
+ * the scalar `log_up`.
+ */
+static const double log_slack = 0x1p-40;
+
+__attribute__((target("avx2"))) static inline __m256i v4_float_bits(
+    __m256d x)
+{
+	const __m256i bits = _mm256_castpd_si256(x);
+	const __m256i mask
+	    = _mm256_cmpgt_epi64(_mm256_setzero_si256(), bits);
+
+	return _mm256_xor_si256(bits, _mm256_srli_epi64(mask, 1));
+}
+
+__attribute__((target("avx2"))) static inline __m256d v4_bits_float(
+    __m256i bits)
+{
+	const __m256i mask
+	    = _mm256_cmpgt_epi64(_mm256_setzero_si256(), bits);
+
+	return _mm256_castsi256_pd(
+	    _mm256_xor_si256(bits, _mm256_srli_epi64(mask, 1)));
+}
+
+__attribute__((target("avx2"))) static inline __m256d v4_next_k(
+    __m256d x, uint64_t delta)
+{
+	return v4_bits_float(
+	    _mm256_add_epi64(v4_float_bits(x), _mm256_set1_epi64x(delta)));
+}
+
+/* Round-to-nearest conversion, like the scalar `(double)n`. */
+__attribute__((target("avx2"))) static inline __m256d v4_u64_to_double(
+    __m256i n)
+{
+	/* 2^52 + lo and 2^84 + hi * 2^32, both exact. */
+	const __m256i lo = _mm256_or_si256(
+	    _mm256_and_si256(n, _mm256_set1_epi64x(0xFFFFFFFFULL)),
+	    _mm256_set1_epi64x(0x4330000000000000ULL));
+	const __m256i hi = _mm256_or_si256(_mm256_srli_epi64(n, 32),
+	    _mm256_set1_epi64x(0x4530000000000000ULL));
+	/* hi * 2^32 - 2^52 is exact, so we only round once, in the add. */
+	const __m256d hi_minus_bias = _mm256_sub_pd(_mm256_castsi256_pd(hi),
+	    _mm256_set1_pd(0x1p84 + 0x1p52));
+
+	return _mm256_add_pd(hi_minus_bias, _mm256_castsi256_pd(lo));
+}
+
+/* `log_approx`, for positive normal x. */
+__attribute__((target("avx2"))) static inline __m256d v4_log(__m256d x)
+{
+	const double *table = &log_table[0].c;
+	const __m256i bits = _mm256_castpd_si256(x);
+	const __m256i tmp = _mm256_sub_epi64(
+	    bits, _mm256_set1_epi64x(log_table_offset));
+	/* Each entry is 4 doubles. */
+	const __m256i index = _mm256_slli_epi64(
+	    _mm256_and_si256(_mm256_srli_epi64(tmp, 45),
+		_mm256_set1_epi64x(127)),
+	    2);
+	/*
+	 * No 64-bit arithmetic shift in AVX2: sign-extend the 12-bit
+	 * exponent by hand, and convert to double with the 2^52
+	 * trick, i.e., k = (2^52 + (k ^ 2048)) - (2^52 + 2048).
+	 */
+	const __m256i biased_k = _mm256_xor_si256(
+	    _mm256_srli_epi64(tmp, 52), _mm256_set1_epi64x(0x800));
+	const __m256d k = _mm256_sub_pd(
+	    _mm256_castsi256_pd(_mm256_or_si256(
+		biased_k, _mm256_set1_epi64x(0x4330000000000000ULL))),
+	    _mm256_set1_pd(0x1p52 + 2048));
+	const __m256d z = _mm256_castsi256_pd(_mm256_sub_epi64(bits,
+	    _mm256_and_si256(tmp, _mm256_set1_epi64x(0xFFFULL << 52))));
+
+	const __m256d c = _mm256_i64gather_pd(table, index, 8);
+	const __m256d inv_c = _mm256_i64gather_pd(table + 1, index, 8);
+	const __m256d log_c_hi = _mm256_i64gather_pd(table + 2, index, 8);
+	const __m256d log_c_lo = _mm256_i64gather_pd(table + 3, index, 8);
+
+	const __m256d r = _mm256_mul_pd(_mm256_sub_pd(z, c), inv_c);
+	const __m256d w = _mm256_add_pd(
+	    _mm256_mul_pd(k, _mm256_set1_pd(ln2_hi)), log_c_hi);
+	const __m256d hi = _mm256_add_pd(w, r);
+	const __m256d lo = _mm256_add_pd(_mm256_sub_pd(w, hi), r);
+	const __m256d r2 = _mm256_mul_pd(r, r);
+#define TERM(A, B)                                                           \
+	_mm256_add_pd(_mm256_set1_pd(A), _mm256_mul_pd(r, _mm256_set1_pd(B)))
+	const __m256d q = _mm256_add_pd(
+	    _mm256_add_pd(TERM(-1.0 / 2, 1.0 / 3),
+		_mm256_mul_pd(r2, TERM(-1.0 / 4, 1.0 / 5))),
+	    _mm256_mul_pd(_mm256_mul_pd(r2, r2),
+		_mm256_add_pd(TERM(-1.0 / 6, 1.0 / 7),
+		    _mm256_mul_pd(r2, _mm256_set1_pd(-1.0 / 8)))));
+#undef TERM
+
+	return _mm256_add_pd(hi,
+	    _mm256_add_pd(
+		_mm256_add_pd(lo,
+		    _mm256_add_pd(
+			_mm256_mul_pd(k, _mm256_set1_pd(ln2_lo)), log_c_lo)),
+		_mm256_mul_pd(r2, q)));
+}
+
+__attribute__((target("avx2"))) static inline __m256d v4_log_up(__m256d x)
+{
+	const __m256d r = v4_log(x);
+	const __m256d abs_r = _mm256_andnot_pd(_mm256_set1_pd(-0.0), r);
+
+	return _mm256_add_pd(
+	    r, _mm256_mul_pd(abs_r, _mm256_set1_pd(log_slack)));
+}
+
+__attribute__((target("avx2"))) static inline __m256d v4_sqrt_up(__m256d x)
+{
+	/* sqrt is supposed to be rounded correctly. */
+	return v4_next_k(_mm256_sqrt_pd(x), 1);
+}
+
+__attribute__((target("avx2"))) static void threshold_batch_avx2(
+    const struct martingale_cs_config *config, const uint64_t *n,
+    double *out, size_t count)
+{
+	const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+	/* Signed comparisons on biased values are unsigned comparisons. */
+	const __m256i biased_min_count = _mm256_xor_si256(
+	    _mm256_set1_epi64x(config->min_count), bias);
+	const int scaled = (config->flags & CONFIG_SCALED) != 0;
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		const __m256i vn
+		    = _mm256_loadu_si256((const __m256i *)(n + i));
+		const __m256d too_early = _mm256_castsi256_pd(
+		    _mm256_cmpgt_epi64(biased_min_count,
+			_mm256_xor_si256(vn, bias)));
+		const __m256d n_double = v4_u64_to_double(vn);
+		const __m256d log_log_n = v4_log_up(v4_log_up(n_double));
+		const __m256d inner = v4_next_k(
+		    _mm256_add_pd(v4_next_k(_mm256_add_pd(_mm256_mul_pd(
+						    _mm256_set1_pd(0.5),
+						    log_log_n),
+					       _mm256_set1_pd(
+						   minus_half_log_log_2_up)),
+				      1),
+			_mm256_set1_pd(config->quarter_log_a)),
+		    1);
+		__m256d threshold = v4_next_k(
+		    _mm256_mul_pd(_mm256_set1_pd(3),
+			v4_sqrt_up(v4_next_k(
+			    _mm256_mul_pd(n_double, inner), 1))),
+		    1);
+
+		if (scaled) {
+			threshold = v4_next_k(
+			    _mm256_mul_pd(
+				_mm256_set1_pd(config->scale), threshold),
+			    1);
+		}
+
+		_mm256_storeu_pd(out + i,
+		    _mm256_blendv_pd(
+			threshold, _mm256_set1_pd(HUGE_VAL), too_early));
+	}
+
+	for (; i < count; ++i) {
+		out[i] = martingale_cs_config_threshold(config, n[i]);
+	}
+}
+
+#define AVX512_TARGET __attribute__((target("avx512f,avx512dq")))
+
+AVX512_TARGET static inline __m512i v8_float_bits(__m512d x)
+{
+	const __m512i bits = _mm512_castpd_si512(x);
+
+	return _mm512_xor_si512(
+	    bits, _mm512_srli_epi64(_mm512_srai_epi64(bits, 63), 1));
+}
+
+AVX512_TARGET static inline __m512d v8_bits_float(__m512i bits)
+{
+	return _mm512_castsi512_pd(_mm512_xor_si512(
+	    bits, _mm512_srli_epi64(_mm512_srai_epi64(bits, 63), 1)));
+}
+
+AVX512_TARGET static inline __m512d v8_next_k(__m512d x, uint64_t delta)
+{
+	return v8_bits_float(
+	    _mm512_add_epi64(v8_float_bits(x), _mm512_set1_epi64(delta)));
+}
+
+/* `log_approx`, for positive normal x. */
+AVX512_TARGET static inline __m512d v8_log(__m512d x)
+{
+	const double *table = &log_table[0].c;
+	const __m512i bits = _mm512_castpd_si512(x);
+	const __m512i tmp
+	    = _mm512_sub_epi64(bits, _mm512_set1_epi64(log_table_offset));
+	/* Each entry is 4 doubles. */
+	const __m512i index = _mm512_slli_epi64(
+	    _mm512_and_si512(
+		_mm512_srli_epi64(tmp, 45), _mm512_set1_epi64(127)),
+	    2);
+	const __m512d k = _mm512_cvtepi64_pd(_mm512_srai_epi64(tmp, 52));
+	const __m512d z = _mm512_castsi512_pd(_mm512_sub_epi64(bits,
+	    _mm512_and_si512(tmp, _mm512_set1_epi64(0xFFFULL << 52))));
+
+	const __m512d c = _mm512_i64gather_pd(index, table, 8);
+	const __m512d inv_c = _mm512_i64gather_pd(index, table + 1, 8);
+	const __m512d log_c_hi = _mm512_i64gather_pd(index, table + 2, 8);
+	const __m512d log_c_lo = _mm512_i64gather_pd(index, table + 3, 8);
+
+	const __m512d r = _mm512_mul_pd(_mm512_sub_pd(z, c), inv_c);
+	const __m512d w = _mm512_add_pd(
+	    _mm512_mul_pd(k, _mm512_set1_pd(ln2_hi)), log_c_hi);
+	const __m512d hi = _mm512_add_pd(w, r);
+	const __m512d lo = _mm512_add_pd(_mm512_sub_pd(w, hi), r);
+	const __m512d r2 = _mm512_mul_pd(r, r);
+#define TERM(A, B)                                                           \
+	_mm512_add_pd(_mm512_set1_pd(A), _mm512_mul_pd(r, _mm512_set1_pd(B)))
+	const __m512d q = _mm512_add_pd(
+	    _mm512_add_pd(TERM(-1.0 / 2, 1.0 / 3),
+		_mm512_mul_pd(r2, TERM(-1.0 / 4, 1.0 / 5))),
+	    _mm512_mul_pd(_mm512_mul_pd(r2, r2),
+		_mm512_add_pd(TERM(-1.0 / 6, 1.0 / 7),
+		    _mm512_mul_pd(r2, _mm512_set1_pd(-1.0 / 8)))));
+#undef TERM
+
+	return _mm512_add_pd(hi,
+	    _mm512_add_pd(
+		_mm512_add_pd(lo,
+		    _mm512_add_pd(
+			_mm512_mul_pd(k, _mm512_set1_pd(ln2_lo)), log_c_lo)),
+		_mm512_mul_pd(r2, q)));
+}
+
+AVX512_TARGET static inline __m512d v8_log_up(__m512d x)
+{
+	const __m512d r = v8_log(x);
+	const __m512d abs_r = _mm512_abs_pd(r);
+
+	return _mm512_add_pd(
+	    r, _mm512_mul_pd(abs_r, _mm512_set1_pd(log_slack)));
+}
+
+AVX512_TARGET static inline __m512d v8_sqrt_up(__m512d x)
+{
+	/* sqrt is supposed to be rounded correctly. */
+	return v8_next_k(_mm512_sqrt_pd(x), 1);
+}
+
+AVX512_TARGET static void threshold_batch_avx512(
+    const struct martingale_cs_config *config, const uint64_t *n,
+    double *out, size_t count)
+{
+	const __m512i min_count = _mm512_set1_epi64(config->min_count);
+	const int scaled = (config->flags & CONFIG_SCALED) != 0;
+	size_t i;
+
+	for (i = 0; i + 8 <= count; i += 8) {
+		const __m512i vn = _mm512_loadu_si512(n + i);
+		const __mmask8 too_early
+		    = _mm512_cmplt_epu64_mask(vn, min_count);
+		/* Rounds to nearest, like the scalar `(double)n`. */
+		const __m512d n_double = _mm512_cvtepu64_pd(vn);
+		const __m512d log_log_n = v8_log_up(v8_log_up(n_double));
+		const __m512d inner = v8_next_k(
+		    _mm512_add_pd(v8_next_k(_mm512_add_pd(_mm512_mul_pd(
+						    _mm512_set1_pd(0.5),
+						    log_log_n),
+					       _mm512_set1_pd(
+						   minus_half_log_log_2_up)),
+				      1),
+			_mm512_set1_pd(config->quarter_log_a)),
+		    1);
+		__m512d threshold = v8_next_k(
+		    _mm512_mul_pd(_mm512_set1_pd(3),
+			v8_sqrt_up(v8_next_k(
+			    _mm512_mul_pd(n_double, inner), 1))),
+		    1);
+
+		if (scaled) {
+			threshold = v8_next_k(
+			    _mm512_mul_pd(
+				_mm512_set1_pd(config->scale), threshold),
+			    1);
+		}
+
+		_mm512_storeu_pd(out + i,
+		    _mm512_mask_blend_pd(
+			too_early, threshold, _mm512_set1_pd(HUGE_VAL)));
+	}
+
+	for (; i < count; ++i) {
+		out[i] = martingale_cs_config_threshold(config, n[i]);
+	}
+}
+#endif /* MARTINGALE_CS_X86_BATCH */
+
+int martingale_cs_batch_isa(void)
+{
+#if MARTINGALE_CS_X86_BATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")
+	    && __builtin_cpu_supports("avx512dq")) {
+		return MARTINGALE_CS_ISA_AVX512;
+	}
+
+	if (__builtin_cpu_supports("avx2")) {
+		return MARTINGALE_CS_ISA_AVX2;
+	}
+#endif
+
+	return MARTINGALE_CS_ISA_SCALAR;
+}
+
+void martingale_cs_config_threshold_batch_isa(
+    const struct martingale_cs_config *config, int isa, const uint64_t *n,
+    double *out, size_t count)
+{
+	const int best = martingale_cs_batch_isa();
+
+	if (isa > best) {
+		isa = best;
 	}
 
-	return next(scale * martingale_cs_threshold(n, min_count, log_eps));
+	/* Degenerate configs are cheap (and constant) anyway. */
+	if ((config->flags & (CONFIG_ALWAYS_REJECT | CONFIG_ZERO)) != 0) {
+		isa = MARTINGALE_CS_ISA_SCALAR;
+	}
+
+	switch (isa) {
+#if MARTINGALE_CS_X86_BATCH
+	case MARTINGALE_CS_ISA_AVX512:
+		threshold_batch_avx512(config, n, out, count);
+		return;
+	case MARTINGALE_CS_ISA_AVX2:
+		threshold_batch_avx2(config, n, out, count);
+		return;
+#endif
+	default:
+		break;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = martingale_cs_config_threshold(config, n[i]);
+	}
+}
+
+void martingale_cs_config_threshold_batch(
+    const struct martingale_cs_config *config, const uint64_t *n,
+    double *out, size_t count)
+{
+	martingale_cs_config_threshold_batch_isa(
+	    config, martingale_cs_batch_isa(), n, out, count);
+}
+
+void martingale_cs_threshold_batch(const uint64_t *n, double *out,
+    size_t count, uint64_t min_count, double log_eps)
+{
+	struct martingale_cs_config config;
+
+	martingale_cs_config_init(&config, min_count, log_eps);
+	martingale_cs_config_threshold_batch(&config, n, out, count);
+}
+
+void martingale_cs_threshold_span_batch(const uint64_t *n, double *out,
+    size_t count, uint64_t min_count, double span, double log_eps)
+{
+	struct martingale_cs_config config;
+
+	martingale_cs_config_init_span(&config, min_count, span, log_eps);
+	martingale_cs_config_threshold_batch(&config, n, out, count);
+}
+
+void martingale_cs_threshold_range_batch(const uint64_t *n, double *out,
+    size_t count, uint64_t min_count, double lo, double hi, double log_eps)
+{
+	struct martingale_cs_config config;
+
+	martingale_cs_config_init_range(&config, min_count, lo, hi, log_eps);
+	martingale_cs_config_threshold_batch(&config, n, out, count);
 }
 
 double martingale_cs_quantile_slop(
@@ -321,3 +1354,90 @@ double martingale_cs_quantile_slop_lo(
 	return -1 - martingale_cs_threshold_range(n, min_count, -quantile,
 			1 - quantile, log_eps + martingale_cs_eq);
 }
+
+void martingale_cs_quantile_interval(double quantile, uint64_t n,
+    uint64_t min_count, double log_eps, double *slop_lo, double *slop_hi)
+{
+	assert(quantile >= 0 && quantile <= 1.0
+	    && "Quantile is a fraction in [0, 1]. Was a percentile passed in "
+	       "without dividing by 100?");
+
+	if (quantile <= 0.0 || quantile >= 1.0) {
+		*slop_lo = martingale_cs_quantile_slop_lo(
+		    quantile, n, min_count, log_eps);
+		*slop_hi = martingale_cs_quantile_slop_hi(
+		    quantile, n, min_count, log_eps);
+		return;
+	}
+
+	/*
+	 * Same as `martingale_cs_quantile_slop_lo` and `_hi`, but
+	 * both ranges `[-quantile, 1 - quantile]` and `[quantile - 1,
+	 * quantile]` straddle 0, so `martingale_cs_threshold_range`
+	 * reduces to scaling the shared threshold.
+	 */
+	const double threshold = martingale_cs_threshold(
+	    n, min_count, log_eps + martingale_cs_eq);
+
+	const double lo_scale = range_scale(-quantile, 1 - quantile);
+	const double hi_scale = range_scale(quantile - 1, quantile);
+
+	*slop_lo = -1 - scale_threshold(lo_scale, threshold);
+	*slop_hi = 1 + scale_threshold(hi_scale, threshold);
+}
+
+void martingale_cs_quantile_scale_init(
+    struct martingale_cs_quantile_scale *scale, double quantile)
+{
+	assert(quantile >= 0 && quantile <= 1.0
+	    && "Quantile is a fraction in [0, 1]. Was a percentile passed in "
+	       "without dividing by 100?");
+
+	scale->quantile = quantile;
+	scale->lo_scale = HUGE_VAL;
+	scale->hi_scale = HUGE_VAL;
+	/* The edge quantiles don't use the threshold at all. */
+	if (quantile > 0.0 && quantile < 1.0) {
+		scale->lo_scale = range_scale(-quantile, 1 - quantile);
+		scale->hi_scale = range_scale(quantile - 1, quantile);
+	}
+}
+
+void martingale_cs_quantile_config_init(
+    struct martingale_cs_config *config, uint64_t min_count,
+    double log_eps, size_t count, int simultaneous)
+{
+	log_eps += martingale_cs_eq;
+	if (simultaneous && count > 1) {
+		/* Union bound: eps / count for each quantile. */
+		log_eps = prev(log_eps - log_up((double)count));
+	}
+
+	martingale_cs_config_init(config, min_count, log_eps);
+}
+
+void martingale_cs_quantile_intervals(
+    const struct martingale_cs_config *config,
+    const struct martingale_cs_quantile_scale *scales, size_t count,
+    uint64_t n, double *slop_lo, double *slop_hi)
+{
+	const double threshold = martingale_cs_config_threshold(config, n);
+
+	for (size_t i = 0; i < count; i++) {
+		const double quantile = scales[i].quantile;
+
+		if (quantile <= 0.0) {
+			slop_lo[i] = -HUGE_VAL;
+			slop_hi[i] = 1;
+		} else if (quantile >= 1.0) {
+			slop_lo[i] = -1;
+			slop_hi[i] = HUGE_VAL;
+		} else {
+			const double lo = scales[i].lo_scale;
+			const double hi = scales[i].hi_scale;
+
+			slop_lo[i] = -1 - scale_threshold(lo, threshold);
+			slop_hi[i] = 1 + scale_threshold(hi, threshold);
+		}
+	}
+}
@@ -1,6 +1,7 @@
 #ifndef MARTINGALE_CS_H
 #define MARTINGALE_CS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -23,6 +24,17 @@ extern const double martingale_cs_eq;
  */
 int martingale_cs_check_constants(void);
 
+/*
+ * The library computes logarithms with its own kernel, not libm's.
+ * These functions expose that kernel, for testing: `log_up` returns
+ * an upper bound on `log(x)`, and `log2_down` a lower bound on
+ * `log2(x)`, for positive normal `x`.  Both are within 16 ULPs of the
+ * exact value.
+ */
+double martingale_cs_log_up(double x);
+
+double martingale_cs_log2_down(double x);
+
 /*
  * Confidence interval sequence for simple martingales.
  *
@@ -109,6 +121,263 @@ double martingale_cs_threshold_span(
 double martingale_cs_threshold_range(
     uint64_t n, uint64_t min_count, double lo, double hi, double log_eps);
 
+/*
+ * Precomputed parameters for `martingale_cs_threshold`,
+ * `martingale_cs_threshold_span` or `martingale_cs_threshold_range`.
+ *
+ * Most of the work in these functions only depends on `min_count`
+ * and `log_eps` (and on the range of the summands), not on `n`.
+ * Initialise a config once with one of the `martingale_cs_config_init`
+ * functions, and pass it to `martingale_cs_config_threshold` to only
+ * pay for the terms that depend on `n`.
+ *
+ * As for the functions above, add `martingale_cs_eq` to `log_eps`
+ * for the half-interval of a two-sided test.
+ *
+ * The fields are private; they are only exposed so that callers may
+ * allocate configs wherever they want.
+ */
+struct martingale_cs_config {
+	uint64_t min_count;
+	double quarter_log_a;
+	double scale;
+	int flags;
+};
+
+/*
+ * Initialises `config` for `martingale_cs_threshold(n, min_count,
+ * log_eps)`.
+ */
+void martingale_cs_config_init(
+    struct martingale_cs_config *config, uint64_t min_count, double log_eps);
+
+/*
+ * Initialises `config` for `martingale_cs_threshold_span(n,
+ * min_count, span, log_eps)`.
+ */
+void martingale_cs_config_init_span(struct martingale_cs_config *config,
+    uint64_t min_count, double span, double log_eps);
+
+/*
+ * Initialises `config` for `martingale_cs_threshold_range(n,
+ * min_count, lo, hi, log_eps)`.
+ */
+void martingale_cs_config_init_range(struct martingale_cs_config *config,
+    uint64_t min_count, double lo, double hi, double log_eps);
+
+/*
+ * Returns the same value as the threshold function for which
+ * `config` was initialised, for `n` observations.  The result is
+ * bit-for-bit identical to a direct call, but only computes `log log
+ * n` and a square root.
+ */
+double martingale_cs_config_threshold(
+    const struct martingale_cs_config *config, uint64_t n);
+
+/*
+ * Returns the smallest `n' > n` such that a sum that's currently
+ * `sum` after `n` observations could exceed
+ * `martingale_cs_threshold_span(n', min_count, span, log_eps)`, given
+ * that each observation increases the sum by at most `span`.
+ *
+ * Callers that compare `sum > threshold` after each observation can
+ * skip all comparisons until `n'` observations.  The return value
+ * may be slightly too early (conservative), never too late.  Returns
+ * `UINT64_MAX` if the sum can never exceed the threshold.
+ *
+ * For a two-sided test, pass `|sum|` and add `martingale_cs_eq` to
+ * `log_eps`.
+ */
+uint64_t martingale_cs_next_check(uint64_t n, double sum, double span,
+    uint64_t min_count, double log_eps);
+
+/*
+ * Returns the smallest `n' > n` such that `sum + (n' - n) max_step`
+ * exceeds `martingale_cs_config_threshold(config, n')`, or a
+ * slightly smaller `n'`.  Returns `UINT64_MAX` if there is no such
+ * `n'`.
+ *
+ * `max_step` is the largest increase in the sum for one observation,
+ * e.g., `hi` for a range `[lo, hi]`.
+ */
+uint64_t martingale_cs_config_next_check(
+    const struct martingale_cs_config *config, uint64_t n, double sum,
+    double max_step);
+
+/*
+ * Decision versions of the threshold functions: return non-zero if
+ * `sum` exceeds the corresponding threshold, e.g.,
+ * `martingale_cs_exceeds(sum, n, min_count, log_eps)` is roughly `sum
+ * > martingale_cs_threshold(n, min_count, log_eps)`.
+ *
+ * These functions compare squares instead of computing a square root,
+ * and settle clear-cut cases (including `n < min_count` and `sum <=
+ * 0`) without calling `log`.  They never return true when the
+ * comparison against the threshold would return false, but may return
+ * false when `sum` exceeds the threshold by a relative difference on
+ * the order of 1e-15.
+ *
+ * For a two-sided test, pass `|sum|` and add `martingale_cs_eq` to
+ * `log_eps`.
+ */
+int martingale_cs_exceeds(
+    double sum, uint64_t n, uint64_t min_count, double log_eps);
+
+int martingale_cs_exceeds_span(double sum, uint64_t n, uint64_t min_count,
+    double span, double log_eps);
+
+int martingale_cs_exceeds_range(double sum, uint64_t n, uint64_t min_count,
+    double lo, double hi, double log_eps);
+
+int martingale_cs_config_exceeds(
+    const struct martingale_cs_config *config, double sum, uint64_t n);
+
+/*
+ * Incremental thresholds for the common case where we check the
+ * confidence sequence after each observation.
+ *
+ * The stepper tracks `n` and caches an upper bound on `log log n`
+ * that is valid over a bracket of values of `n`; it only calls `log`
+ * when `n` leaves the current bracket, i.e., O(log n) times in total.
+ * Each call to `martingale_cs_stepper_advance` otherwise only needs a
+ * few multiplications and a square root.
+ *
+ * The thresholds are never less than `martingale_cs_config_threshold`
+ * (they're conservative), but may be slightly (< 1%) larger.
+ *
+ * The fields are private.
+ */
+struct martingale_cs_stepper {
+	struct martingale_cs_config config;
+	uint64_t n;
+	uint64_t bracket_end;
+	double log_log_bound;
+};
+
+/*
+ * Initialises `stepper` for thresholds with `config`, after `n`
+ * observations.  `config` is copied.
+ */
+void martingale_cs_stepper_init(struct martingale_cs_stepper *stepper,
+    const struct martingale_cs_config *config, uint64_t n);
+
+/*
+ * Increments the stepper's observation count and returns the
+ * threshold for the new count `n + 1`.  The return value is at least
+ * `martingale_cs_config_threshold(config, n + 1)`.
+ */
+double martingale_cs_stepper_advance(struct martingale_cs_stepper *stepper);
+
+/*
+ * Batch versions of the threshold functions: `out[i]` receives the
+ * threshold for `n[i]` observations, for `i < count`.
+ *
+ * These functions use AVX2 or AVX-512 kernels when the CPU supports
+ * them.  Every path, scalar or vector, uses the library's table-driven
+ * `log` kernel, not libm's.  The vector kernels follow the scalar
+ * code step by step, but the compiler may contract their `log` series
+ * into FMAs, so they pad each `log` by 2^-40 of its value instead of
+ * a few ULPs: their results may exceed the scalar functions' by a
+ * tiny relative amount (well under 1e-10), but are never smaller
+ * (conservative).
+ */
+void martingale_cs_threshold_batch(const uint64_t *n, double *out,
+    size_t count, uint64_t min_count, double log_eps);
+
+void martingale_cs_threshold_span_batch(const uint64_t *n, double *out,
+    size_t count, uint64_t min_count, double span, double log_eps);
+
+void martingale_cs_threshold_range_batch(const uint64_t *n, double *out,
+    size_t count, uint64_t min_count, double lo, double hi, double log_eps);
+
+void martingale_cs_config_threshold_batch(
+    const struct martingale_cs_config *config, const uint64_t *n,
+    double *out, size_t count);
+
+#define MARTINGALE_CS_ISA_SCALAR 0
+#define MARTINGALE_CS_ISA_AVX2 1
+#define MARTINGALE_CS_ISA_AVX512 2
+
+/*
+ * Returns the widest `MARTINGALE_CS_ISA_*` kernel supported by the
+ * current CPU.  This is the kernel the batch functions use.
+ */
+int martingale_cs_batch_isa(void);
+
+/*
+ * Like `martingale_cs_config_threshold_batch`, but uses the `isa`
+ * kernel, or the widest supported one if the CPU doesn't support
+ * `isa`.  This is mostly useful for testing.
+ */
+void martingale_cs_config_threshold_batch_isa(
+    const struct martingale_cs_config *config, int isa, const uint64_t *n,
+    double *out, size_t count);
+
+/*
+ * Integer-only thresholds for per-observation checks.
+ *
+ * The table splits `n` in geometric buckets, 4 per power of two (and
+ * one per value for `n < 8`), and stores, for each bucket, an integer
+ * upper bound on the threshold at every `n` in the bucket, in units
+ * of `unit`.  Checking a sum accumulated as an integer number of
+ * `unit`s is then a `clz`, a load, and an integer comparison.
+ *
+ * The bounds are at most ~12% looser than the exact thresholds
+ * (sqrt(1.25) for the bucket width, plus a little for log log n), and
+ * infinite (`INT64_MAX`) for buckets that start before `min_count`.
+ */
+#define MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS 2
+#define MARTINGALE_CS_INT_TABLE_SIZE                                         \
+	((65 - MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS)                      \
+	    << MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS)
+
+struct martingale_cs_int_table {
+	int64_t bound[MARTINGALE_CS_INT_TABLE_SIZE];
+};
+
+/*
+ * Fills `table` with bounds on `martingale_cs_config_threshold(config,
+ * n) / unit`, rounded up to integers (saturated at `INT64_MAX`).  For
+ * example, for observations in [-1, 1] measured in 1/1000ths, `unit`
+ * is 0.001 and the sums count thousandths.
+ */
+void martingale_cs_int_table_init(struct martingale_cs_int_table *table,
+    const struct martingale_cs_config *config, double unit);
+
+/* Returns the bucket for `n` in `martingale_cs_int_table.bound`. */
+static inline size_t martingale_cs_int_table_index(uint64_t n)
+{
+	const unsigned sub_bits = MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS;
+	/* n < 2^(sub_bits + 1) is its own bucket. */
+	unsigned shift = 0;
+
+	if ((n >> (sub_bits + 1)) != 0) {
+#if defined(__GNUC__) || defined(__clang__)
+		shift = 63 - sub_bits - __builtin_clzll(n);
+#else
+		while ((n >> (shift + sub_bits + 1)) != 0) {
+			shift++;
+		}
+#endif
+	}
+
+	return ((size_t)shift << sub_bits) + (size_t)(n >> shift);
+}
+
+/*
+ * Returns non-zero if `sum` (in `unit`s) exceeds the table's bound
+ * for `n` observations.  Never true when `sum * unit` is at most
+ * `martingale_cs_config_threshold(config, n)`.
+ *
+ * For a two-sided test, pass `|sum|` and add `martingale_cs_eq` to
+ * `log_eps`.
+ */
+static inline int martingale_cs_int_table_exceeds(
+    const struct martingale_cs_int_table *table, int64_t sum, uint64_t n)
+{
+	return sum > table->bound[martingale_cs_int_table_index(n)];
+}
+
 /*
  * We can use this martingale confidence sequence to estimate
  * quantiles.  However, the intervals aren't as tight as ones derived
@@ -201,6 +470,54 @@ double martingale_cs_quantile_slop_hi(
  */
 double martingale_cs_quantile_slop_lo(
     double quantile, uint64_t n, uint64_t min_count, double log_eps);
+
+/*
+ * Stores `martingale_cs_quantile_slop_lo(quantile, n, min_count,
+ * log_eps)` in `slop_lo` and `martingale_cs_quantile_slop_hi(...)` in
+ * `slop_hi`, with bit-identical results, but only computes the
+ * underlying threshold once.
+ */
+void martingale_cs_quantile_interval(double quantile, uint64_t n,
+    uint64_t min_count, double log_eps, double *slop_lo, double *slop_hi);
+
+/*
+ * Confidence intervals for several quantiles at once (e.g., p50,
+ * p90, p99 and p99.9), from a single threshold evaluation.
+ *
+ * `martingale_cs_quantile_scale_init` precomputes the asymmetric
+ * scale factors for one quantile, and
+ * `martingale_cs_quantile_config_init` the threshold config shared by
+ * all the quantiles.  Both can be reused for any `n`.
+ *
+ * When `simultaneous` is non-zero, the config splits `log_eps`
+ * between `count` quantiles (a union bound), so that all `count`
+ * intervals hold at the same time with probability `1 -
+ * exp(log_eps)`.  Otherwise, each interval holds on its own with that
+ * probability, and the slops are bit-identical to
+ * `martingale_cs_quantile_slop_lo` and `_hi`.
+ */
+struct martingale_cs_quantile_scale {
+	double quantile;
+	double lo_scale;
+	double hi_scale;
+};
+
+void martingale_cs_quantile_scale_init(
+    struct martingale_cs_quantile_scale *scale, double quantile);
+
+void martingale_cs_quantile_config_init(
+    struct martingale_cs_config *config, uint64_t min_count,
+    double log_eps, size_t count, int simultaneous);
+
+/*
+ * Stores the lower and upper slops for each of the `count` quantiles
+ * in `scales` (see `martingale_cs_quantile_slop_lo` and `_hi`) in
+ * `slop_lo[i]` and `slop_hi[i]`.
+ */
+void martingale_cs_quantile_intervals(
+    const struct martingale_cs_config *config,
+    const struct martingale_cs_quantile_scale *scales, size_t count,
+    uint64_t n, double *slop_lo, double *slop_hi);
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,390 @@
+#ifndef MARTINGALE_CS_HPP
+#define MARTINGALE_CS_HPP
+/*
+ * constexpr versions of `martingale_cs_threshold` and
+ * `martingale_cs_threshold_span`, for hard-coded configurations.
+ *
+ * The code mirrors martingale-cs.c operation by operation (including
+ * the table-driven `log_approx`), so the results are bit-identical
+ * to the C functions, as long as neither side is compiled with FMA
+ * contraction.  Either way, both are conservative.
+ *
+ * `threshold_table` precomputes, at compile time, an upper bound on
+ * the threshold for each of a set of geometric buckets of n:
+ *
+ *   constexpr martingale_cs::threshold_table<> table(32, log_eps);
+ *   if (std::fabs(sum) > table(n)) ...
+ *
+ * Requires C++17, and GCC >= 11 or clang >= 9 for
+ * `__builtin_bit_cast` (or C++20's `std::bit_cast`).
+ */
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if __cplusplus >= 202002L
+#include <bit>
+#endif
+
+#include "martingale-cs.h"
+
+namespace martingale_cs {
+namespace detail {
+
+constexpr double kInfinity = std::numeric_limits<double>::infinity();
+
+template <typename To, typename From> constexpr To bit_cast(From x)
+{
+#if defined(__cpp_lib_bit_cast)
+	return std::bit_cast<To>(x);
+#else
+	return __builtin_bit_cast(To, x);
+#endif
+}
+
+/* See `float_bits` and `bits_float` in martingale-cs.c. */
+constexpr uint64_t float_bits(double x)
+{
+	const uint64_t bits = bit_cast<uint64_t>(x);
+	const uint64_t mask = static_cast<uint64_t>(
+	    static_cast<int64_t>(bits) >> 63);
+
+	return bits ^ (mask >> 1);
+}
+
+constexpr double bits_float(uint64_t bits)
+{
+	const uint64_t mask = static_cast<uint64_t>(
+	    static_cast<int64_t>(bits) >> 63);
+
+	return bit_cast<double>(bits ^ (mask >> 1));
+}
+
+constexpr double next_k(double x, uint64_t delta)
+{
+	return bits_float(float_bits(x) + delta);
+}
+
+constexpr double next(double x) { return next_k(x, 1); }
+
+constexpr double prev_k(double x, uint64_t delta)
+{
+	return bits_float(float_bits(x) - delta);
+}
+
+constexpr double prev(double x) { return prev_k(x, 1); }
+
+constexpr double ln2_hi = 6.93147180369123816490e-01;
+constexpr double ln2_lo = 1.90821492927058770002e-10;
+constexpr double log2_e = 1.4426950408889634;
+constexpr double minus_half_log_log_2_up = 0.1832564602908322;
+
+struct log_table_entry {
+	double c;
+	double inv_c;
+	double log_c_hi;
+	double log_c_lo;
+};
+
+inline constexpr log_table_entry log_table[128] = {
+#include "martingale-cs-log-table.inc"
+};
+
+constexpr uint64_t log_table_offset = 0x3FE6000000000000ULL;
+constexpr uint64_t log_error_limit = 4;
+
+/* `log_approx` in martingale-cs.c: log(x) within 3 ULPs. */
+constexpr double log_approx(double x)
+{
+	const uint64_t bits = bit_cast<uint64_t>(x);
+	const uint64_t tmp = bits - log_table_offset;
+	const log_table_entry &entry = log_table[(tmp >> 45) % 128];
+	const double k = static_cast<double>(static_cast<int64_t>(tmp) >> 52);
+	const double z = bit_cast<double>(bits - (tmp & (0xFFFULL << 52)));
+
+	const double r = (z - entry.c) * entry.inv_c;
+	const double w = k * ln2_hi + entry.log_c_hi;
+	const double hi = w + r;
+	const double lo = (w - hi) + r;
+	const double r2 = r * r;
+	const double q = ((-1.0 / 2 + r * (1.0 / 3))
+			     + r2 * (-1.0 / 4 + r * (1.0 / 5)))
+	    + (r2 * r2) * ((-1.0 / 6 + r * (1.0 / 7)) + r2 * (-1.0 / 8));
+
+	return hi + ((lo + (k * ln2_lo + entry.log_c_lo)) + r2 * q);
+}
+
+constexpr double log_up(double x)
+{
+	return next_k(log_approx(x), log_error_limit);
+}
+
+constexpr double log2_down(double x)
+{
+	return prev_k(log_approx(x) * log2_e, log_error_limit + 2);
+}
+
+constexpr double log_log_up(uint64_t n)
+{
+	return log_up(log_up(static_cast<double>(n)));
+}
+
+/* See `log_log_bound_up` in martingale-cs.c. */
+constexpr double log_log_bound_up(uint64_t hi)
+{
+	const uint64_t slack = 2 * log_error_limit;
+
+	return next_k(
+	    log_up(next_k(log_up(static_cast<double>(hi)), slack)), slack);
+}
+
+/* floor(sqrt(x)). */
+constexpr unsigned __int128 isqrt(unsigned __int128 x)
+{
+	unsigned __int128 root = 0;
+	unsigned __int128 bit = static_cast<unsigned __int128>(1) << 126;
+
+	while (bit > x) {
+		bit >>= 2;
+	}
+
+	while (bit != 0) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/*
+ * Correctly rounded sqrt(x) for positive normal `x`, like the IEEE
+ * sqrt that martingale-cs.c relies on.
+ *
+ * Write x = m 2^e, with an integer m and even e, scale m to
+ * [2^104, 2^106) so that its square root has 53 bits, and round that
+ * integer square root to nearest (there are no ties: if
+ * floor(sqrt(M)) = s, M > s^2 + s iff M > (s + 1/2)^2).
+ */
+constexpr double sqrt_nearest(double x)
+{
+	assert(x >= 0x1p-1022 && x < kInfinity);
+
+	const uint64_t bits = bit_cast<uint64_t>(x);
+	unsigned __int128 m = (bits & ((1ULL << 52) - 1)) | (1ULL << 52);
+	int e = static_cast<int>(bits >> 52) - 1075;
+
+	if ((e & 1) != 0) {
+		m <<= 1;
+		e -= 1;
+	}
+
+	/* m is in [2^52, 2^54): m 2^52 is in [2^104, 2^106). */
+	const int shift = 52;
+	const unsigned __int128 scaled = m << shift;
+	uint64_t root = static_cast<uint64_t>(isqrt(scaled));
+	if (scaled - static_cast<unsigned __int128>(root) * root > root) {
+		++root;
+	}
+
+	/* root <= 2^53 is exact, and so is scaling by a power of 2. */
+	const int exponent = (e - shift) / 2;
+	const double scale
+	    = bit_cast<double>(static_cast<uint64_t>(exponent + 1023) << 52);
+	return static_cast<double>(root) * scale;
+}
+
+constexpr double sqrt_up(double x) { return next(sqrt_nearest(x)); }
+
+/* `log_a_up` in martingale-cs.c. */
+constexpr double log_a_up(uint64_t min_count, double log_eps)
+{
+	const double inv_q_m
+	    = prev(log2_down(static_cast<double>(min_count)) - 0.5);
+
+	return log_up(next(1.0 / inv_q_m)) - log_eps;
+}
+
+/* The subset of `martingale_cs_config` that the thresholds need. */
+struct config {
+	uint64_t min_count = 2;
+	double quarter_log_a = 0;
+	bool always_reject = false;
+
+	constexpr config(uint64_t min_count_, double log_eps)
+	{
+		assert(log_eps <= 0
+		    && "Positive log_eps means > 100% false positive rate. "
+		       "Should it be negated?");
+
+		min_count = min_count_ < 2 ? 2 : min_count_;
+		if (log_eps >= 0) {
+			always_reject = true;
+			return;
+		}
+
+		quarter_log_a = 0.25 * log_a_up(min_count, log_eps);
+	}
+
+	constexpr double threshold_log_log(uint64_t n, double log_log_n) const
+	{
+		const double inner
+		    = next(next(.5 * log_log_n + minus_half_log_log_2_up)
+			+ quarter_log_a);
+		return next(
+		    3 * sqrt_up(next(static_cast<double>(n) * inner)));
+	}
+
+	constexpr double unit_threshold(uint64_t n) const
+	{
+		if (n < min_count) {
+			return kInfinity;
+		}
+
+		if (always_reject) {
+			return -kInfinity;
+		}
+
+		return threshold_log_log(n, log_log_up(n));
+	}
+};
+
+constexpr double scale_threshold(double scale, double threshold)
+{
+	if (threshold == kInfinity) {
+		return kInfinity;
+	}
+
+	return next(scale * threshold);
+}
+
+} // namespace detail
+
+/* `martingale_cs_threshold`, at compile time. */
+constexpr double threshold(uint64_t n, uint64_t min_count, double log_eps)
+{
+	if (n < min_count) {
+		return detail::kInfinity;
+	}
+
+	return detail::config(min_count, log_eps).unit_threshold(n);
+}
+
+/* `martingale_cs_threshold_span`, at compile time. */
+constexpr double threshold_span(
+    uint64_t n, uint64_t min_count, double span, double log_eps)
+{
+	return detail::scale_threshold(
+	    span / 2, threshold(n, min_count, log_eps));
+}
+
+/*
+ * Upper bounds on `martingale_cs_threshold_span` over geometric
+ * buckets of n: each power-of-two range [2^k, 2^(k+1)) is split in
+ * 2^SubBucketBits equal buckets, and values of n less than
+ * 2^(SubBucketBits + 1) get their own bucket.  With the default of 4
+ * buckets per octave, the bound is at most ~12% looser than the
+ * exact threshold (sqrt(1.25), plus a sliver for log log n).
+ *
+ * Each entry is the threshold at the last n in the bucket, computed
+ * with an upper bound on log log n over the whole bucket
+ * (`log_log_bound_up`).  Buckets that start below `min_count` are
+ * infinite: callers should never reject in them.
+ */
+template <unsigned SubBucketBits = 2> class threshold_table {
+	static_assert(SubBucketBits < 16, "Too many buckets per octave");
+
+    public:
+	static constexpr size_t kSize = (65 - SubBucketBits) << SubBucketBits;
+
+	constexpr threshold_table(
+	    uint64_t min_count, double log_eps, double span = 2)
+	{
+		const detail::config config(min_count, log_eps);
+
+		for (size_t i = 0; i < kSize; ++i) {
+			const uint64_t lo = bucket_begin(i);
+			const uint64_t hi = bucket_end(i);
+			double bound = detail::kInfinity;
+
+			if (lo >= config.min_count) {
+				bound = config.always_reject
+				    ? -detail::kInfinity
+				    : config.threshold_log_log(
+					hi, detail::log_log_bound_up(hi));
+			}
+
+			thresholds_[i]
+			    = detail::scale_threshold(span / 2, bound);
+		}
+	}
+
+	/* Returns an upper bound on the threshold for n observations. */
+	constexpr double operator()(uint64_t n) const
+	{
+		return thresholds_[index(n)];
+	}
+
+	static constexpr size_t index(uint64_t n)
+	{
+		const unsigned log2 = 63 - __builtin_clzll(n | 1);
+
+		const unsigned shift
+		    = log2 > SubBucketBits ? log2 - SubBucketBits : 0;
+		return (static_cast<size_t>(shift) << SubBucketBits)
+		    + static_cast<size_t>(n >> shift);
+	}
+
+	static constexpr uint64_t bucket_begin(size_t index)
+	{
+		if (index < (size_t(2) << SubBucketBits)) {
+			return index;
+		}
+
+		const unsigned shift = (index >> SubBucketBits) - 1;
+		return (index - (static_cast<size_t>(shift) << SubBucketBits))
+		    << shift;
+	}
+
+	static constexpr uint64_t bucket_end(size_t index)
+	{
+		if (index < (size_t(2) << SubBucketBits)) {
+			return index;
+		}
+
+		const unsigned shift = (index >> SubBucketBits) - 1;
+		return bucket_begin(index) + ((uint64_t(1) << shift) - 1);
+	}
+
+	constexpr const std::array<double, kSize> &thresholds() const
+	{
+		return thresholds_;
+	}
+
+    private:
+	std::array<double, kSize> thresholds_{};
+};
+
+#if defined(__cpp_nontype_template_args)                                     \
+    && __cpp_nontype_template_args >= 201911L
+/*
+ * C++20 only (floating-point template arguments): a table for a fixed
+ * configuration, e.g., `static_threshold_table<32, -6.9>(n)`.
+ */
+template <uint64_t MinCount, double LogEps, double Span = 2.0,
+    unsigned SubBucketBits = 2>
+inline constexpr threshold_table<SubBucketBits> static_threshold_table {
+	MinCount, LogEps, Span
+};
+#endif
+
+} // namespace martingale_cs
+#endif /* !MARTINGALE_CS_HPP */
@@ -0,0 +1,448 @@
+// Microbenchmarks for the martingale-CS entry points.  BM_Sweep times
+// each scalar function for a range of n, in latency and throughput
+// modes.  Export to JSON with
+//
+//   bazel run -c opt :martingale-cs_benchmark --
+//       --benchmark_out=bench.json --benchmark_out_format=json
+
+#include "martingale-cs.h"
+#include "martingale-cs-pool.h"
+#include "martingale-cs-quantile.h"
+#include "martingale-cs-slo.h"
+#include "martingale-cs-tester.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+namespace {
+static const uint64_t kMinCount = 32;
+static const double kLogEps = std::log(1e-3) + martingale_cs_eq;
+
+// Every scalar entry point in martingale-cs.h, as a function of n.
+// `near` is 90% of `martingale_cs_threshold` for the sweep's first n:
+// the decision functions get sums close enough to the threshold that
+// they can't take their shortcuts.  Span 3 and range [-1, 2] both
+// scale the threshold by 1.5.
+double Threshold(uint64_t n, double)
+{
+	return martingale_cs_threshold(n, kMinCount, kLogEps);
+}
+
+double ThresholdSpan(uint64_t n, double)
+{
+	return martingale_cs_threshold_span(n, kMinCount, 3, kLogEps);
+}
+
+double ThresholdRange(uint64_t n, double)
+{
+	return martingale_cs_threshold_range(n, kMinCount, -1, 2, kLogEps);
+}
+
+double ConfigThreshold(uint64_t n, double)
+{
+	static const struct martingale_cs_config config = [] {
+		struct martingale_cs_config ret;
+
+		martingale_cs_config_init(&ret, kMinCount, kLogEps);
+		return ret;
+	}();
+
+	return martingale_cs_config_threshold(&config, n);
+}
+
+double Exceeds(uint64_t n, double near)
+{
+	return martingale_cs_exceeds(near, n, kMinCount, kLogEps);
+}
+
+double ExceedsSpan(uint64_t n, double near)
+{
+	return martingale_cs_exceeds_span(
+	    1.5 * near, n, kMinCount, 3, kLogEps);
+}
+
+double ExceedsRange(uint64_t n, double near)
+{
+	return martingale_cs_exceeds_range(
+	    1.5 * near, n, kMinCount, -1, 2, kLogEps);
+}
+
+double NextCheck(uint64_t n, double near)
+{
+	return martingale_cs_next_check(n, near, 2, kMinCount, kLogEps);
+}
+
+double QuantileSlop(uint64_t n, double)
+{
+	return martingale_cs_quantile_slop(0.5, n, kMinCount, kLogEps);
+}
+
+double QuantileSlopHi(uint64_t n, double)
+{
+	return martingale_cs_quantile_slop_hi(0.99, n, kMinCount, kLogEps);
+}
+
+double QuantileSlopLo(uint64_t n, double)
+{
+	return martingale_cs_quantile_slop_lo(0.99, n, kMinCount, kLogEps);
+}
+
+double QuantileInterval(uint64_t n, double)
+{
+	double lo, hi;
+
+	martingale_cs_quantile_interval(
+	    0.99, n, kMinCount, kLogEps, &lo, &hi);
+	return lo + hi;
+}
+
+// Calls `fn` on n = range(0) + small offsets.  In throughput mode
+// (range(1) == 0), the calls are independent, and the CPU can overlap
+// them.  In latency mode, each n depends on the previous result, so we
+// measure the full latency of one call.
+template <typename Fn> void BM_Sweep(benchmark::State &state, Fn fn)
+{
+	const uint64_t base = state.range(0);
+	const bool latency = state.range(1) != 0;
+	const double near = 0.9 * Threshold(base, 0);
+	uint64_t offset = 0;
+
+	if (latency) {
+		for (auto _ : state) {
+			const double result = fn(base + offset, near);
+			uint64_t bits;
+
+			std::memcpy(&bits, &result, sizeof(bits));
+			offset = bits & 1;
+		}
+	} else {
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(fn(base + offset, near));
+			offset = (offset + 1) & 1023;
+		}
+	}
+}
+
+// n small, 2^20, 2^40, and close to 2^63.
+void SweepArgs(benchmark::internal::Benchmark *bench)
+{
+	bench->ArgNames({ "n", "latency" });
+	for (int64_t n : { int64_t(1000), int64_t(1) << 20, int64_t(1) << 40,
+		 (int64_t(1) << 62) + ((int64_t(1) << 62) - 4096) }) {
+		bench->Args({ n, 0 });
+		bench->Args({ n, 1 });
+	}
+}
+
+BENCHMARK_CAPTURE(BM_Sweep, Threshold, Threshold)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, ThresholdSpan, ThresholdSpan)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, ThresholdRange, ThresholdRange)
+    ->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, ConfigThreshold, ConfigThreshold)
+    ->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, Exceeds, Exceeds)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, ExceedsSpan, ExceedsSpan)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, ExceedsRange, ExceedsRange)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, NextCheck, NextCheck)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, QuantileSlop, QuantileSlop)->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, QuantileSlopHi, QuantileSlopHi)
+    ->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, QuantileSlopLo, QuantileSlopLo)
+    ->Apply(SweepArgs);
+BENCHMARK_CAPTURE(BM_Sweep, QuantileInterval, QuantileInterval)
+    ->Apply(SweepArgs);
+
+// Decision without the square root, for a sum close to the threshold
+// (can't prefilter), and far from it (can).
+void BM_ConfigExceeds(benchmark::State &state)
+{
+	struct martingale_cs_config config;
+	const uint64_t n = state.range(0);
+	const double ratio = state.range(1) / 100.0;
+
+	martingale_cs_config_init(&config, kMinCount, kLogEps);
+	const double sum = ratio * martingale_cs_config_threshold(&config, n);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+		    martingale_cs_config_exceeds(&config, sum, n));
+	}
+}
+
+BENCHMARK(BM_ConfigExceeds)
+    ->Args({ 1000, 100 })
+    ->Args({ 1 << 20, 100 })
+    ->Args({ 1 << 20, 10 });
+
+// One threshold per observation, with a stepper.
+void BM_StepperAdvance(benchmark::State &state)
+{
+	struct martingale_cs_config config;
+	struct martingale_cs_stepper stepper;
+
+	martingale_cs_config_init(&config, kMinCount, kLogEps);
+	martingale_cs_stepper_init(&stepper, &config, state.range(0));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+		    martingale_cs_stepper_advance(&stepper));
+	}
+}
+
+BENCHMARK(BM_StepperAdvance)->Arg(1000)->Arg(1 << 20)->Arg(1LL << 40);
+
+// Integer-only check, with a sum that never exceeds the bound.
+void BM_IntTableExceeds(benchmark::State &state)
+{
+	struct martingale_cs_config config;
+	struct martingale_cs_int_table table;
+	uint64_t n = state.range(0);
+
+	martingale_cs_config_init(&config, kMinCount, kLogEps);
+	martingale_cs_int_table_init(&table, &config, 1e-3);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+		    martingale_cs_int_table_exceeds(&table, 1000, n++));
+	}
+}
+
+BENCHMARK(BM_IntTableExceeds)->Arg(1000)->Arg(1 << 20)->Arg(1LL << 40);
+
+// Streaming tester under the null: mostly an add and a compare.
+void BM_TesterPush(benchmark::State &state)
+{
+	struct martingale_cs_tester tester;
+	uint64_t bits = 0x9E3779B97F4A7C15ULL;
+
+	martingale_cs_tester_init(&tester, kMinCount, -1, 1, kLogEps, 1);
+	for (auto _ : state) {
+		// xorshift: fair coin flips.
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		benchmark::DoNotOptimize(martingale_cs_tester_push(
+		    &tester, (bits & 1) ? 1.0 : -1.0));
+	}
+}
+
+BENCHMARK(BM_TesterPush);
+
+// Streaming quantile interval: one insertion and two selections per
+// observation.
+void BM_QuantilePushBounds(benchmark::State &state)
+{
+	struct martingale_cs_quantile engine;
+	uint64_t bits = 0x9E3779B97F4A7C15ULL;
+	double lo, hi;
+
+	martingale_cs_quantile_init(&engine, 0.99, kMinCount, kLogEps);
+	for (auto _ : state) {
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		martingale_cs_quantile_push(&engine, bits >> 11);
+		martingale_cs_quantile_bounds(&engine, &lo, &hi);
+		benchmark::DoNotOptimize(lo);
+		benchmark::DoNotOptimize(hi);
+	}
+
+	martingale_cs_quantile_deinit(&engine);
+}
+
+BENCHMARK(BM_QuantilePushBounds);
+
+// Per-value cost of filling an HDR histogram with wide-range values.
+void BM_HdrPushMany(benchmark::State &state)
+{
+	struct martingale_cs_quantile_hdr hdr;
+	std::vector<uint64_t> values(4096);
+	uint64_t bits = 0x9E3779B97F4A7C15ULL;
+
+	for (uint64_t &x : values) {
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		x = bits >> (bits % 64);
+	}
+
+	martingale_cs_quantile_hdr_init(
+	    &hdr, MARTINGALE_CS_QUANTILE_HDR_DEFAULT_BITS);
+	for (auto _ : state) {
+		martingale_cs_quantile_hdr_push_many(
+		    &hdr, values.data(), values.size());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetItemsProcessed(state.iterations() * values.size());
+	martingale_cs_quantile_hdr_deinit(&hdr);
+}
+
+BENCHMARK(BM_HdrPushMany);
+
+// Per-sample counting cost for 3 quantiles x 8 budgets.
+void BM_SloSetPushMany(benchmark::State &state)
+{
+	std::vector<struct martingale_cs_slo_spec> specs;
+	struct martingale_cs_slo_set set;
+	std::vector<double> latencies(4096);
+	uint64_t bits = 0x9E3779B97F4A7C15ULL;
+
+	for (double quantile : { 0.5, 0.9, 0.99 }) {
+		for (size_t i = 0; i < 8; ++i) {
+			const double budget = (i + 1) / 9.0;
+
+			specs.push_back(
+			    { quantile, budget, kMinCount, kLogEps });
+		}
+	}
+
+	for (double &x : latencies) {
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		x = std::ldexp(static_cast<double>(bits >> 11), -53);
+	}
+
+	martingale_cs_slo_set_init(&set, specs.data(), specs.size());
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(martingale_cs_slo_set_push_many(
+		    &set, latencies.data(), latencies.size()));
+	}
+
+	state.SetItemsProcessed(state.iterations() * latencies.size());
+	martingale_cs_slo_set_deinit(&set);
+}
+
+BENCHMARK(BM_SloSetPushMany);
+
+// Exceedance counting for SLO monitors, with each kernel.
+void BM_CountExceed(benchmark::State &state)
+{
+	std::vector<double> latencies(4096);
+	uint64_t bits = 0x9E3779B97F4A7C15ULL;
+	const int isa = state.range(0);
+
+	if (isa > martingale_cs_batch_isa()) {
+		state.SkipWithError("ISA not supported");
+		return;
+	}
+
+	for (double &x : latencies) {
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		x = std::ldexp(static_cast<double>(bits >> 11), -53);
+	}
+
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(martingale_cs_count_exceed_isa(
+		    isa, latencies.data(), latencies.size(), 0.99));
+	}
+
+	state.SetItemsProcessed(state.iterations() * latencies.size());
+}
+
+BENCHMARK(BM_CountExceed)
+    ->Arg(MARTINGALE_CS_ISA_SCALAR)
+    ->Arg(MARTINGALE_CS_ISA_AVX2)
+    ->Arg(MARTINGALE_CS_ISA_AVX512);
+
+// Scatter 64K observations over 1M pooled tests, then sweep the due
+// ones, with each kernel.
+void BM_PoolAddSweep(benchmark::State &state)
+{
+	const size_t kTests = 1 << 20;
+	const uint64_t min_counts[] = { kMinCount, 1000 };
+	const double log_eps[] = { kLogEps, std::log(1e-6) };
+	const int isa = state.range(0);
+	std::vector<uint32_t> ids(1 << 16);
+	std::vector<int64_t> values(ids.size());
+	struct martingale_cs_pool pool;
+	uint64_t bits = 0x9E3779B97F4A7C15ULL;
+
+	if (isa > martingale_cs_batch_isa()) {
+		state.SkipWithError("ISA not supported");
+		return;
+	}
+
+	martingale_cs_pool_init(
+	    &pool, kTests, -1, 1, min_counts, 2, log_eps, 2);
+	for (uint32_t i = 0; i < kTests; ++i) {
+		martingale_cs_pool_set_config(&pool, i, i % 2, (i / 2) % 2);
+	}
+
+	for (size_t i = 0; i < ids.size(); ++i) {
+		bits ^= bits << 13;
+		bits ^= bits >> 7;
+		bits ^= bits << 17;
+		ids[i] = bits % kTests;
+		values[i] = (bits >> 32) % 2 ? 1 : -1;
+	}
+
+	for (auto _ : state) {
+		martingale_cs_pool_add(
+		    &pool, ids.data(), values.data(), ids.size());
+		benchmark::DoNotOptimize(
+		    martingale_cs_pool_sweep_isa(&pool, isa));
+	}
+
+	state.SetItemsProcessed(state.iterations() * ids.size());
+	martingale_cs_pool_deinit(&pool);
+}
+
+BENCHMARK(BM_PoolAddSweep)
+    ->Arg(MARTINGALE_CS_ISA_SCALAR)
+    ->Arg(MARTINGALE_CS_ISA_AVX512);
+
+// Earliest possible crossing for a sum at 0, i.e., how long a monitor
+// may go without checking.
+void BM_NextCheck(benchmark::State &state)
+{
+	struct martingale_cs_config config;
+	const uint64_t n = state.range(0);
+
+	martingale_cs_config_init(&config, kMinCount, kLogEps);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(
+		    martingale_cs_config_next_check(&config, n, 0, 1));
+	}
+}
+
+BENCHMARK(BM_NextCheck)->Arg(1000)->Arg(1 << 20)->Arg(1LL << 40);
+
+// Batch of 1024 thresholds at a time, with each kernel.
+void BM_ConfigThresholdBatch(benchmark::State &state)
+{
+	struct martingale_cs_config config;
+	std::vector<uint64_t> ns(1024);
+	std::vector<double> out(ns.size());
+	const int isa = state.range(0);
+
+	if (isa > martingale_cs_batch_isa()) {
+		state.SkipWithError("ISA not supported");
+		return;
+	}
+
+	for (size_t i = 0; i < ns.size(); ++i) {
+		ns[i] = 1000 + 17 * i;
+	}
+
+	martingale_cs_config_init(&config, kMinCount, kLogEps);
+	for (auto _ : state) {
+		martingale_cs_config_threshold_batch_isa(
+		    &config, isa, ns.data(), out.data(), ns.size());
+		benchmark::DoNotOptimize(out.data());
+	}
+
+	state.SetItemsProcessed(state.iterations() * ns.size());
+}
+
+BENCHMARK(BM_ConfigThresholdBatch)
+    ->Arg(MARTINGALE_CS_ISA_SCALAR)
+    ->Arg(MARTINGALE_CS_ISA_AVX2)
+    ->Arg(MARTINGALE_CS_ISA_AVX512);
+} // namespace
+
+BENCHMARK_MAIN();
@@ -1,7 +1,12 @@
 #include "martingale-cs.h"
 
+#include <cfloat>
 #include <climits>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -10,11 +15,74 @@ namespace {
 using ::testing::DoubleNear;
 using ::testing::Lt;
 
+// Compares doubles bit for bit (NaNs included).
+uint64_t Bits(double x)
+{
+	uint64_t bits;
+
+	std::memcpy(&bits, &x, sizeof(bits));
+	return bits;
+}
+
 TEST(MartingaleCs, ConstantsOk)
 {
 	EXPECT_EQ(martingale_cs_check_constants(), 0);
 }
 
+// The log checks need a reference that's more precise than double.
+#if LDBL_MANT_DIG > 53
+// Returns how far `x` is above `reference`, in units of 2^-52
+// |reference| (at least one ULP).
+long double UlpsAbove(double x, long double reference)
+{
+	return (x - reference) / (std::fabs(reference) * 0x1p-52L);
+}
+
+void CheckLog(double x)
+{
+	if (x == 1) {
+		return;
+	}
+
+	const long double log = std::log(static_cast<long double>(x));
+	const long double log2 = std::log2(static_cast<long double>(x));
+	const long double up = UlpsAbove(martingale_cs_log_up(x), log);
+	const long double down = UlpsAbove(martingale_cs_log2_down(x), log2);
+
+	ASSERT_GE(up, 0) << std::hexfloat << x;
+	ASSERT_LE(up, 16) << std::hexfloat << x;
+	ASSERT_LE(down, 0) << std::hexfloat << x;
+	ASSERT_GE(down, -16) << std::hexfloat << x;
+}
+
+// Compare the log kernel against x87 long doubles, exhaustively for
+// small integers (and their logs), and for random doubles.
+TEST(MartingaleCs, LogConservative)
+{
+	EXPECT_GT(martingale_cs_log_up(1), 0);
+	EXPECT_LT(martingale_cs_log_up(1), 1e-300);
+
+	for (uint64_t n = 2; n < (1ULL << 20); ++n) {
+		CheckLog(n);
+		CheckLog(martingale_cs_log_up(n));
+	}
+
+	std::mt19937_64 rng(3);
+	for (size_t i = 0; i < 1000000; ++i) {
+		const uint64_t significand = rng() & ((1ULL << 52) - 1);
+		const uint64_t exponent = 1023 + (rng() % 256) - 128;
+		const uint64_t bits = significand | (exponent << 52);
+		double x;
+
+		std::memcpy(&x, &bits, sizeof(x));
+		CheckLog(x);
+		// And close to 1.
+		CheckLog(1 + std::ldexp(x, -140));
+		CheckLog(1 - std::ldexp(x, -140));
+	}
+}
+#endif
+
 // Darling and Robbins have an example with
 // a = c = 2, m = 32, eps = 0.05.
 //  -> A = 80/9,
@@ -36,6 +104,13 @@ TEST(MartingaleCs, TooEarly)
 	EXPECT_EQ(martingale_cs_threshold(1, 10, -10), HUGE_VAL);
 }
 
+// The scaled variants also return +infty before min_count.
+TEST(MartingaleCs, TooEarlyScaled)
+{
+	EXPECT_EQ(martingale_cs_threshold_span(1, 10, 3, -10), HUGE_VAL);
+	EXPECT_EQ(martingale_cs_threshold_range(1, 10, -2, 1, -10), HUGE_VAL);
+}
+
 TEST(MartingaleCs, DefaultMinCount)
 {
 	EXPECT_EQ(martingale_cs_threshold(1, 1, -10), HUGE_VAL);
@@ -89,4 +164,387 @@ TEST(MartingaleCs, Quantile)
 			       std::log(0.01) + martingale_cs_eq),
 		1e-6));
 }
+
+TEST(MartingaleCs, QuantileInterval)
+{
+	static const double kQuantiles[] = { 0, 1e-6, 0.1, 0.5, 0.75, 0.99,
+		1 };
+
+	for (double quantile : kQuantiles) {
+		for (uint64_t n : { 0, 10, 32, 1000, 1 << 20 }) {
+			double lo, hi;
+
+			martingale_cs_quantile_interval(
+			    quantile, n, 32, -5, &lo, &hi);
+			EXPECT_EQ(Bits(lo),
+			    Bits(martingale_cs_quantile_slop_lo(
+				quantile, n, 32, -5)))
+			    << quantile << " " << n;
+			EXPECT_EQ(Bits(hi),
+			    Bits(martingale_cs_quantile_slop_hi(
+				quantile, n, 32, -5)))
+			    << quantile << " " << n;
+		}
+	}
+}
+
+TEST(MartingaleCs, QuantileIntervals)
+{
+	static const double kQuantiles[] = { 0, 0.5, 0.9, 0.99, 0.999, 1 };
+	static const size_t kCount
+	    = sizeof(kQuantiles) / sizeof(kQuantiles[0]);
+	struct martingale_cs_quantile_scale scales[kCount];
+	struct martingale_cs_config each, all, split;
+	double lo[kCount], hi[kCount], all_lo[kCount], all_hi[kCount];
+
+	for (size_t i = 0; i < kCount; ++i) {
+		martingale_cs_quantile_scale_init(&scales[i], kQuantiles[i]);
+	}
+
+	martingale_cs_quantile_config_init(&each, 32, -5, kCount, 0);
+	martingale_cs_quantile_config_init(&all, 32, -5, kCount, 1);
+	// Simultaneous intervals split eps between the quantiles.
+	martingale_cs_config_init(
+	    &split, 32, -5 + martingale_cs_eq - std::log(kCount));
+	for (uint64_t n : { 0, 10, 32, 1000, 1 << 20 }) {
+		martingale_cs_quantile_intervals(
+		    &each, scales, kCount, n, lo, hi);
+		martingale_cs_quantile_intervals(
+		    &all, scales, kCount, n, all_lo, all_hi);
+		for (size_t i = 0; i < kCount; ++i) {
+			const double quantile = kQuantiles[i];
+
+			EXPECT_EQ(Bits(lo[i]),
+			    Bits(martingale_cs_quantile_slop_lo(
+				quantile, n, 32, -5)))
+			    << quantile << " " << n;
+			EXPECT_EQ(Bits(hi[i]),
+			    Bits(martingale_cs_quantile_slop_hi(
+				quantile, n, 32, -5)))
+			    << quantile << " " << n;
+			EXPECT_LE(all_lo[i], lo[i]);
+			EXPECT_GE(all_hi[i], hi[i]);
+		}
+	}
+
+	EXPECT_GE(martingale_cs_config_threshold(&all, 1000),
+	    martingale_cs_config_threshold(&split, 1000));
+}
+
+// Precomputed configs must match the direct calls exactly.
+TEST(MartingaleCs, ConfigMatches)
+{
+	static const uint64_t kMinCounts[] = { 0, 1, 2, 10, 32, 1000 };
+	static const double kLogEps[] = { 0, -1e-3, -2, -10, -100 };
+	static const uint64_t kNs[] = { 0, 1, 2, 3, 9, 10, 31, 32, 33, 1000,
+		123456789, 1ULL << 40, UINT64_MAX };
+
+	for (uint64_t min_count : kMinCounts) {
+		for (double log_eps : kLogEps) {
+			struct martingale_cs_config unit, span, range, flat;
+
+			martingale_cs_config_init(&unit, min_count, log_eps);
+			martingale_cs_config_init_span(
+			    &span, min_count, 3.5, log_eps);
+			martingale_cs_config_init_range(
+			    &range, min_count, -2.5, 0.5, log_eps);
+			martingale_cs_config_init_range(
+			    &flat, min_count, 0.5, 1, log_eps);
+			for (uint64_t n : kNs) {
+				EXPECT_EQ(Bits(martingale_cs_config_threshold(
+					      &unit, n)),
+				    Bits(martingale_cs_threshold(
+					n, min_count, log_eps)));
+				EXPECT_EQ(Bits(martingale_cs_config_threshold(
+					      &span, n)),
+				    Bits(martingale_cs_threshold_span(
+					n, min_count, 3.5, log_eps)));
+				EXPECT_EQ(Bits(martingale_cs_config_threshold(
+					      &range, n)),
+				    Bits(martingale_cs_threshold_range(
+					n, min_count, -2.5, 0.5, log_eps)));
+				EXPECT_EQ(Bits(martingale_cs_config_threshold(
+					      &flat, n)),
+				    Bits(martingale_cs_threshold_range(
+					n, min_count, 0.5, 1, log_eps)));
+			}
+		}
+	}
+}
+
+// The stepper must never be less conservative than the exact
+// threshold, and should be close.
+TEST(MartingaleCs, StepperConservative)
+{
+	static const uint64_t kStarts[] = { 0, 30, 1000, 1ULL << 40,
+		UINT64_MAX - 100001 };
+
+	for (uint64_t start : kStarts) {
+		struct martingale_cs_config unit, span;
+		struct martingale_cs_stepper unit_stepper, span_stepper;
+
+		martingale_cs_config_init(&unit, 32, -10);
+		martingale_cs_config_init_span(&span, 32, 5, -10);
+		martingale_cs_stepper_init(&unit_stepper, &unit, start);
+		martingale_cs_stepper_init(&span_stepper, &span, start);
+		for (uint64_t n = start + 1; n <= start + 100000; ++n) {
+			const double expected
+			    = martingale_cs_config_threshold(&unit, n);
+			const double actual
+			    = martingale_cs_stepper_advance(&unit_stepper);
+
+			ASSERT_GE(actual, expected) << n;
+			ASSERT_LE(actual, expected * 1.01) << n;
+			ASSERT_GE(
+			    martingale_cs_stepper_advance(&span_stepper),
+			    martingale_cs_config_threshold(&span, n))
+			    << n;
+		}
+	}
+}
+
+TEST(MartingaleCs, IntTableConservative)
+{
+	const auto index = martingale_cs_int_table_index;
+	struct martingale_cs_config configs[5];
+	std::mt19937_64 rng(3);
+
+	martingale_cs_config_init(&configs[0], 32, -10);
+	martingale_cs_config_init_span(&configs[1], 100, 5, -3);
+	martingale_cs_config_init_range(&configs[2], 2, -0.5, 2, -20);
+	martingale_cs_config_init(&configs[3], 10, 0);
+	martingale_cs_config_init_range(&configs[4], 10, 0, 1, -1);
+
+	for (const auto &config : configs) {
+		for (double unit : { 1.0, 1e-3, 1.0 / 64 }) {
+			struct martingale_cs_int_table table;
+			uint64_t expected_lo = 0;
+
+			martingale_cs_int_table_init(&table, &config, unit);
+			for (size_t i = 0; i < MARTINGALE_CS_INT_TABLE_SIZE;
+			     ++i) {
+				// 8 singleton buckets, then 4 per power of 2.
+				const unsigned bits
+				    = MARTINGALE_CS_INT_TABLE_SUB_BUCKET_BITS;
+				const uint64_t lo = expected_lo;
+				const uint64_t hi = (i < (2U << bits))
+				    ? lo
+				    : lo + (1ULL << ((i >> bits) - 1)) - 1;
+
+				ASSERT_EQ(index(lo), i);
+				ASSERT_EQ(index(hi), i);
+				if (hi < UINT64_MAX) {
+					ASSERT_EQ(index(hi + 1), i + 1);
+				}
+				expected_lo = hi + 1;
+
+				// No int64_t sum exceeds INT64_MAX.
+				const int64_t bound = table.bound[i];
+				for (uint64_t n :
+				    { lo, hi, lo + rng() % (hi - lo + 1) }) {
+					const double threshold
+					    = martingale_cs_config_threshold(
+						&config, n);
+					ASSERT_TRUE(bound == INT64_MAX
+					    || (long double)bound * unit
+						>= threshold)
+					    << i << " " << n;
+				}
+
+				if (lo >= config.min_count && bound > 0
+				    && bound < INT64_MAX) {
+					const double exact
+					    = martingale_cs_config_threshold(
+						&config, lo);
+					ASSERT_LE(bound * unit,
+					    1.13 * exact + unit)
+					    << lo;
+				}
+			}
+
+			// The last bucket ends at UINT64_MAX.
+			EXPECT_EQ(expected_lo, 0);
+		}
+	}
+}
+
+// Compare against a linear search: we must never skip a point where
+// the sum could cross the threshold.
+TEST(MartingaleCs, NextCheck)
+{
+	std::mt19937_64 rng(1);
+	std::uniform_real_distribution<double> unit(0, 1);
+
+	for (size_t i = 0; i < 200; ++i) {
+		const uint64_t n = rng() % 5000;
+		const double span = 0.1 + 2 * unit(rng);
+		const double log_eps = -1 - 20 * unit(rng);
+		const double threshold
+		    = martingale_cs_threshold_span(n, 32, span, log_eps);
+		const double sum = (std::isinf(threshold) ? 10 : threshold)
+		    * (2 * unit(rng) - 1);
+
+		uint64_t expected = n + 1;
+		while (sum + (expected - n) * span
+		    <= martingale_cs_threshold_span(
+			expected, 32, span, log_eps)) {
+			++expected;
+		}
+
+		const uint64_t actual
+		    = martingale_cs_next_check(n, sum, span, 32, log_eps);
+		EXPECT_LE(actual, expected);
+		EXPECT_GT(actual, n);
+		// Only off by rounding.
+		EXPECT_GE(sum + (actual - n) * span,
+		    martingale_cs_threshold_span(actual, 32, span, log_eps)
+			* (1 - 1e-10));
+	}
+}
+
+TEST(MartingaleCs, NextCheckEdgeCases)
+{
+	struct martingale_cs_config config;
+
+	martingale_cs_config_init(&config, 32, -5);
+	// Can't cross before min_count.
+	EXPECT_EQ(martingale_cs_config_next_check(&config, 0, 100, 1), 32);
+	// Sum can't increase: never.
+	EXPECT_EQ(martingale_cs_config_next_check(&config, 100, 0, 0),
+	    UINT64_MAX);
+	EXPECT_EQ(martingale_cs_config_next_check(&config, UINT64_MAX, 0, 1),
+	    UINT64_MAX);
+	// Already past the threshold.
+	EXPECT_EQ(martingale_cs_config_next_check(&config, 100, 1e6, 0), 101);
+
+	martingale_cs_config_init(&config, 32, 0);
+	EXPECT_EQ(
+	    martingale_cs_config_next_check(&config, 100, -1e6, 0), 101);
+}
+
+// The decision functions must agree with the thresholds, except for
+// sums within rounding of the threshold, where they must say no.
+TEST(MartingaleCs, Exceeds)
+{
+	std::mt19937_64 rng(2);
+	std::uniform_real_distribution<double> unit(0, 1);
+
+	for (size_t i = 0; i < 20000; ++i) {
+		const uint64_t n = rng() >> (rng() % 64);
+		const uint64_t min_count = rng() % 100;
+		const double log_eps = -20 * unit(rng);
+		const double lo = -3 * unit(rng);
+		const double hi = 3 * unit(rng);
+		const double threshold = martingale_cs_threshold_range(
+		    n, min_count, lo, hi, log_eps);
+		const double base = std::isinf(threshold) ? 1e6 : threshold;
+		// Mostly close to the threshold, with a few far away.
+		const double sum = (unit(rng) < 0.1)
+		    ? base * (4 * unit(rng) - 2)
+		    : base * (1 + (unit(rng) - 0.5) * 1e-3);
+		const bool exceeds = martingale_cs_exceeds_range(
+		    sum, n, min_count, lo, hi, log_eps);
+
+		if (exceeds) {
+			EXPECT_GT(sum, threshold);
+		} else if (sum > threshold) {
+			EXPECT_LE(sum, threshold * (1 + 1e-12));
+		}
+
+		struct martingale_cs_config config;
+		martingale_cs_config_init_range(
+		    &config, min_count, lo, hi, log_eps);
+		EXPECT_EQ(martingale_cs_config_exceeds(&config, sum, n) != 0,
+		    exceeds);
+	}
+}
+
+TEST(MartingaleCs, ExceedsEdgeCases)
+{
+	EXPECT_FALSE(martingale_cs_exceeds(1e300, 5, 10, -5));
+	EXPECT_FALSE(martingale_cs_exceeds(-1e300, 50, 10, -5));
+	EXPECT_TRUE(martingale_cs_exceeds(1e300, 50, 10, -5));
+	EXPECT_TRUE(martingale_cs_exceeds(-1e300, 50, 10, 0));
+	EXPECT_TRUE(martingale_cs_exceeds_span(1e-300, 0, 10, 1, 0) == 0);
+	EXPECT_TRUE(martingale_cs_exceeds_range(1e-300, 0, 10, 0, 1, -5));
+
+	for (uint64_t n = 10; n < 10000; ++n) {
+		const double threshold = martingale_cs_threshold_span(
+		    n, 10, 0.5, -5);
+		EXPECT_FALSE(martingale_cs_exceeds_span(
+		    threshold, n, 10, 0.5, -5));
+		EXPECT_TRUE(martingale_cs_exceeds_span(
+		    threshold * (1 + 1e-12), n, 10, 0.5, -5));
+	}
+}
+
+// Every kernel must be at least as conservative as the scalar code,
+// and not much more.
+TEST(MartingaleCs, BatchConservative)
+{
+	std::mt19937_64 rng(42);
+	std::vector<uint64_t> ns = { 0, 1, 2, 3, 4, 31, 32, 33, 1000,
+		(1ULL << 53) + 1, UINT64_MAX - 1, UINT64_MAX };
+
+	for (size_t i = 0; i < 2000; ++i) {
+		ns.push_back(rng() >> (rng() % 64));
+	}
+
+	for (int isa = MARTINGALE_CS_ISA_SCALAR;
+	     isa <= martingale_cs_batch_isa(); ++isa) {
+		for (double log_eps : { -1e-3, -3.0, -50.0 }) {
+			struct martingale_cs_config unit, range;
+			std::vector<double> out(ns.size());
+
+			martingale_cs_config_init(&unit, 32, log_eps);
+			martingale_cs_config_init_range(
+			    &range, 32, -3, 0.25, log_eps);
+			for (const auto *config : { &unit, &range }) {
+				martingale_cs_config_threshold_batch_isa(
+				    config, isa, ns.data(), out.data(),
+				    ns.size());
+				for (size_t i = 0; i < ns.size(); ++i) {
+					const double expected
+					    = martingale_cs_config_threshold(
+						config, ns[i]);
+
+					EXPECT_GE(out[i], expected)
+					    << isa << " " << ns[i];
+					EXPECT_LE(out[i],
+					    expected * (1 + 1e-10))
+					    << isa << " " << ns[i];
+				}
+			}
+		}
+	}
+}
+
+TEST(MartingaleCs, BatchWrappers)
+{
+	const std::vector<uint64_t> ns = { 1, 10, 100, 1000, 10000 };
+	std::vector<double> out(ns.size());
+
+	martingale_cs_threshold_batch(
+	    ns.data(), out.data(), ns.size(), 10, -5);
+	for (size_t i = 0; i < ns.size(); ++i) {
+		EXPECT_THAT(out[i],
+		    DoubleNear(martingale_cs_threshold(ns[i], 10, -5), 1e-9));
+	}
+
+	martingale_cs_threshold_span_batch(
+	    ns.data(), out.data(), ns.size(), 10, 0.5, -5);
+	for (size_t i = 0; i < ns.size(); ++i) {
+		EXPECT_THAT(out[i],
+		    DoubleNear(
+			martingale_cs_threshold_span(ns[i], 10, 0.5, -5),
+			1e-9));
+	}
+
+	// Degenerate ranges are always exactly 0.
+	martingale_cs_threshold_range_batch(
+	    ns.data(), out.data(), ns.size(), 10, 0, 1, -5);
+	for (double x : out) {
+		EXPECT_EQ(x, 0);
+	}
+}
 } // namespace
@@ -0,0 +1,353 @@
+// Empirical check of the false positive rate of martingale_cs_threshold:
+// simulate many independent +/-1 random walks, and count how many ever
+// cross the threshold, for a grid of (min_count, log_eps).
+//
+//   martingale-cs_walk --min_count=32,1000 --log_eps=-3,-5
+//       --steps=1e9 --walks=6400
+//
+// Each walk is a counter of +1 steps, c, so that the sum after n steps
+// is 2c - n.  The counters for 64 walks are bit-sliced across 64-bit
+// words (plane k holds bit k of every counter), so one step for 64
+// walks is a ripple-carry increment of the planes by 64 random bits:
+// a couple of word operations on average.
+//
+// Checking every walk against the threshold after every step would
+// dominate the run time, so we only check blocks of steps where a
+// crossing is possible: the sum moves by at most 1 per step, and the
+// threshold only grows, so a block of kBlock steps can't cross if
+// every live walk is more than kBlock away from the threshold at the
+// start of the block.  In the other blocks, we compare the counters
+// against the exact threshold at every step; a table of conservative
+// (larger) thresholds would under-count crossings.
+//
+// Prints the crossing rate for each side, and whether csm can tell it
+// apart from exp(log_eps) at the 1e-4 level.
+
+#include "martingale-cs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "external/csm/csm.h"
+
+namespace {
+// Supports up to 2^40 steps per walk.
+constexpr size_t kPlanes = 40;
+constexpr uint64_t kBlock = 64;
+
+// xoshiro256**, seeded with splitmix64.
+class Rng {
+    public:
+	explicit Rng(uint64_t seed)
+	{
+		for (uint64_t &s : state_) {
+			seed += 0x9E3779B97F4A7C15ULL;
+			uint64_t x = seed;
+			x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+			x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+			s = x ^ (x >> 31);
+		}
+	}
+
+	uint64_t operator()()
+	{
+		const uint64_t ret = Rotl(state_[1] * 5, 7) * 9;
+		const uint64_t t = state_[1] << 17;
+
+		state_[2] ^= state_[0];
+		state_[3] ^= state_[1];
+		state_[1] ^= state_[2];
+		state_[0] ^= state_[3];
+		state_[2] ^= t;
+		state_[3] = Rotl(state_[3], 45);
+		return ret;
+	}
+
+    private:
+	static uint64_t Rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t state_[4];
+};
+
+// 64 bit-sliced counters.
+struct Counters {
+	uint64_t planes[kPlanes] = {};
+
+	// Adds bit i of `bits` to counter i.
+	void Increment(uint64_t bits)
+	{
+		for (size_t k = 0; bits != 0; ++k) {
+			const uint64_t carry = planes[k] & bits;
+
+			planes[k] ^= bits;
+			bits = carry;
+		}
+	}
+
+	// Returns the mask of counters strictly greater than `x`.
+	uint64_t Greater(uint64_t x) const
+	{
+		uint64_t gt = 0;
+		uint64_t eq = ~0ULL;
+
+		if (x >> kPlanes) {
+			return 0;
+		}
+
+		for (size_t k = kPlanes; k-- > 0;) {
+			if ((x >> k) & 1) {
+				eq &= planes[k];
+			} else {
+				gt |= eq & planes[k];
+				eq &= ~planes[k];
+			}
+		}
+
+		return gt;
+	}
+
+	// Mask of counters >= x.
+	uint64_t AtLeast(int64_t x) const
+	{
+		return (x <= 0) ? ~0ULL : Greater(x - 1);
+	}
+
+	// Mask of counters <= x.
+	uint64_t AtMost(int64_t x) const
+	{
+		return (x < 0) ? 0 : ~Greater(x);
+	}
+};
+
+struct Crossings {
+	uint64_t up;
+	uint64_t down;
+};
+
+// The smallest integer sum that exceeds the threshold for n steps, or
+// INT64_MAX if there is none.
+int64_t MinCrossing(const struct martingale_cs_config &config, uint64_t n)
+{
+	const double threshold = martingale_cs_config_threshold(&config, n);
+
+	if (!(threshold < static_cast<double>(n))) {
+		return INT64_MAX;
+	}
+
+	return static_cast<int64_t>(std::floor(std::fmax(threshold, -1))) + 1;
+}
+
+// Simulates 64 walks for `steps` steps, and returns the number that
+// cross the threshold upward and downward.
+Crossings Simulate(
+    const struct martingale_cs_config &config, uint64_t steps, Rng &rng)
+{
+	Counters counters;
+	uint64_t crossed_up = 0;
+	uint64_t crossed_down = 0;
+
+	for (uint64_t n = 0; n < steps;) {
+		const uint64_t block = std::min(kBlock, steps - n);
+		const int64_t first = MinCrossing(config, n + 1);
+		const int64_t last = MinCrossing(config, n + block);
+		bool maybe = true;
+
+		if (first == INT64_MAX) {
+			// No crossing at the start of the block (n <
+			// min_count, or threshold > n); if that's also true
+			// at the end, it's true in between.
+			maybe = last != INT64_MAX;
+		} else {
+			// The thresholds only grow with n, up to rounding in
+			// log log n: give it a little slack.
+			const int64_t lowest = first - 1;
+			const int64_t start = static_cast<int64_t>(n);
+			const int64_t length = static_cast<int64_t>(block);
+			// The sum, 2c - n, must get to `lowest` within
+			// `block` steps, i.e., 2c - n + block >= lowest ...
+			const uint64_t maybe_up = counters.AtLeast(
+			    (lowest - length + start + 1) / 2);
+			// ... or down to -lowest: 2c - n - block <= -lowest.
+			const uint64_t maybe_down = counters.AtMost(
+			    (length - lowest + start) >> 1);
+
+			maybe = ((maybe_up & ~crossed_up)
+				    | (maybe_down & ~crossed_down))
+			    != 0;
+		}
+
+		if (!maybe) {
+			for (uint64_t i = 0; i < block; ++i) {
+				counters.Increment(rng());
+			}
+
+			n += block;
+			continue;
+		}
+
+		for (uint64_t i = 0; i < block; ++i) {
+			counters.Increment(rng());
+			++n;
+
+			const int64_t m = MinCrossing(config, n);
+			if (m == INT64_MAX) {
+				continue;
+			}
+
+			// 2c - n >= m, and 2c - n <= -m.
+			const int64_t count = static_cast<int64_t>(n);
+			crossed_up |= counters.AtLeast((m + count + 1) / 2);
+			crossed_down |= counters.AtMost((count - m) >> 1);
+		}
+	}
+
+	return { static_cast<uint64_t>(__builtin_popcountll(crossed_up)),
+		static_cast<uint64_t>(__builtin_popcountll(crossed_down)) };
+}
+
+// Simulates `batches` of 64 walks on `num_threads` threads.
+Crossings SimulateBatches(const struct martingale_cs_config &config,
+    uint64_t steps, uint64_t batches, uint64_t seed, size_t num_threads)
+{
+	std::atomic<uint64_t> next_batch(0);
+	std::atomic<uint64_t> up(0), down(0);
+	std::vector<std::thread> workers;
+
+	for (size_t i = 0; i < num_threads; ++i) {
+		workers.emplace_back([&] {
+			for (;;) {
+				const uint64_t batch = next_batch++;
+
+				if (batch >= batches) {
+					return;
+				}
+
+				// One stream per batch, so results don't
+				// depend on the number of threads.
+				Rng rng(seed ^ (batch << 20));
+				const Crossings crossings
+				    = Simulate(config, steps, rng);
+
+				up += crossings.up;
+				down += crossings.down;
+			}
+		});
+	}
+
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+
+	return { up.load(), down.load() };
+}
+
+std::vector<double> ParseList(const char *arg)
+{
+	std::vector<double> ret;
+
+	for (const char *p = arg; *p != '\0';) {
+		char *end;
+		const double value = std::strtod(p, &end);
+
+		if (end == p) {
+			break;
+		}
+
+		ret.push_back(value);
+		p = (*end == ',') ? end + 1 : end;
+	}
+
+	return ret;
+}
+
+const char *Verdict(uint64_t walks, uint64_t crossings, double eps)
+{
+	if (!csm(walks, eps, crossings, std::log(1e-4), nullptr)) {
+		return "inconclusive";
+	}
+
+	return (crossings < eps * walks) ? "below eps" : "ABOVE EPS";
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	std::vector<double> min_counts = { 32 };
+	std::vector<double> log_eps_values = { std::log(0.05) };
+	uint64_t steps = 1000000;
+	uint64_t walks = 6400;
+	uint64_t seed = 42;
+	size_t num_threads = std::thread::hardware_concurrency();
+
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+		const char *value = std::strchr(arg, '=');
+
+		if (value == nullptr) {
+			std::fprintf(stderr, "Unknown argument %s\n", arg);
+			return 1;
+		}
+
+		const std::string name(arg, value++);
+		if (name == "--min_count") {
+			min_counts = ParseList(value);
+		} else if (name == "--log_eps") {
+			log_eps_values = ParseList(value);
+		} else if (name == "--steps") {
+			steps = std::strtod(value, nullptr);
+		} else if (name == "--walks") {
+			walks = std::strtod(value, nullptr);
+		} else if (name == "--seed") {
+			seed = std::strtoull(value, nullptr, 0);
+		} else if (name == "--threads") {
+			num_threads = std::strtoull(value, nullptr, 0);
+		} else {
+			std::fprintf(stderr, "Unknown argument %s\n", arg);
+			return 1;
+		}
+	}
+
+	if (steps >> kPlanes) {
+		std::fprintf(stderr, "At most 2^%zu steps.\n", kPlanes);
+		return 1;
+	}
+
+	const uint64_t batches = (walks + 63) / 64;
+	walks = 64 * batches;
+	num_threads = std::max<size_t>(num_threads, 1);
+	std::printf("min_count log_eps walks steps up_rate down_rate eps "
+		    "up_verdict down_verdict\n");
+	for (double min_count : min_counts) {
+		for (double log_eps : log_eps_values) {
+			struct martingale_cs_config config;
+
+			martingale_cs_config_init(
+			    &config, min_count, log_eps);
+
+			const Crossings crossings = SimulateBatches(
+			    config, steps, batches, seed, num_threads);
+			const double eps = std::exp(log_eps);
+			std::printf("%" PRIu64 " %g %" PRIu64 " %" PRIu64
+				    " %g %g %g %s %s\n",
+			    static_cast<uint64_t>(min_count), log_eps, walks,
+			    steps, 1.0 * crossings.up / walks,
+			    1.0 * crossings.down / walks, eps,
+			    Verdict(walks, crossings.up, eps),
+			    Verdict(walks, crossings.down, eps));
+		}
+	}
+
+	return 0;
+}